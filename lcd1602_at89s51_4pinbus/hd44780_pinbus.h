@@ -18,9 +18,10 @@
 // 8bit-bus-no-read:        Same as 8bit-bus mode with no read
 // 8bit-bus-port:           Same as 8bit-bus mode, but uses the whole group IO e.g. P2
 // 8bit-bus-port-no-read:   No read
+// sr595-bus:               4bit-bus-no-read through a 74HC595 shifted by the UART in mode 0: RXD to SER, TXD to SRCLK, plus a latch pin to RCLK
 
 // Usage:
-// 1. Define your connection mode, available options are LCD_BUS_4BIT, LCD_BUS_8BIT or LCD_BUS_8P
+// 1. Define your connection mode, available options are LCD_BUS_4BIT, LCD_BUS_8BIT, LCD_BUS_8P or LCD_BUS_SR595
 // 2. Define LCD_NO_READ if you do not use the read function, and soft delay will be used instead of waiting for the busy flag
 // 3. Change the definitions of IOs, XTAL_FREQ and MCU_CYCLE accordingly, this will be used in the calculation of delays later
 
@@ -53,8 +54,33 @@
 #define LCD_BUS_4BIT
 // #define LCD_BUS_8BIT
 // #define LCD_BUS_8P
+// #define LCD_BUS_SR595
 
 // #define LCD_NO_READ
+// #define LCD_DEFERRED_WAIT       // Wait for the busy flag before the next access rather than after each command
+// #define LCD_CALIBRATE           // Time the busy flag at disp_start() (uses Timer0): disp_get_cal() gives the waits of this panel
+// #define LCD_CAL_CMD 0           // With LCD_NO_READ, the waits disp_get_cal() returned for this panel instead of the
+// #define LCD_CAL_CLR 0           // worst case ones (same XTAL_FREQ and MCU_CYCLE)
+// #define LCD_CALIBRATE_LOOPS     // Time the soft delay loops at disp_start() (uses Timer0): FN_DELAY_* right whatever MCU_CYCLE says
+// #define LCD_SHADOW              // Shadow screen: disp_* draw in it, disp_flush() sends what changed
+// #define LCD_SHADOW_ROWS 2       // Its geometry, 2x16 by default
+// #define LCD_SHADOW_COLS 16
+// #define LCD_SHADOW_IRAM 48      // Bytes of __idata the buffer (rows*columns*9/8) may take: a 20x4 needs an 8052
+                                   // with a higher limit and --iram-size 256, or LCD_SHADOW_MEM __xdata (not checked)
+
+/*-------Several controllers sharing the data bus, each with its own E line (M68)--------*/
+
+// 40x4 modules have two HD44780s, rows 0~1 on the first E line and rows 2~3 on the second. Several panels can
+// also share the data, RS and RW lines with one E line each: disp_select() picks the one the next functions
+// talk to, or DISP_ALL to write to all of them. IO_E_WR is the E line of controller 0, IO_E2_WR of 1, etc.
+
+// #define LCD_CONTROLLERS 2       // Up to 4
+// #define LCD_40X4                // Controllers 0 and 1 are the halves of a 40x4, disp_put_cur() routes the rows
+
+#ifdef  LCD_BUS_SR595
+#define LCD_BUS_4BIT            // The LCD side of the 74HC595 is a 4 bit bus
+#define LCD_NO_READ             // and write only
+#endif
 
 /*----------Uncomment the following options to enable light adjust for VFDs----------*/
 
@@ -66,15 +92,23 @@
 #define IO_RS       P1_6    // The RS pin 
 #define IO_RW_RD    P1_5    // RW pin in m68 mode or RD pin in i80 mode. Notice that usually the RW pin in m68 mode is multiplexed with WR in i80 mode
 #define IO_E_WR     P1_4    // Enable pin in m68 mode or WR pin in i80 mode
+#define IO_E2_WR    P1_7    // Enable pins of the other controllers, if LCD_CONTROLLERS > 1
+#define IO_E3_WR    P3_4
+#define IO_E4_WR    P3_5
 #ifdef  LCD_NO_READ
 #undef  IO_RW_RD
 #endif
 
 #ifdef  LCD_BUS_4BIT
-#define IO_D4   P1_0
-#define IO_D5   P1_1
-#define IO_D6   P1_2
-#define IO_D7   P1_3
+// D4~D7 on consecutive bits of one port: the port and the bit of D4 (0 to 4). IO_D4~IO_D7 follow from them
+// and the data line accesses are grouped into whole port operations. If the data pins are scattered,
+// comment out these two and define IO_D4~IO_D7 instead.
+#define IO_D_PORT   P1
+#define IO_D_SHIFT  0
+//#define IO_D4   P1_0
+//#define IO_D5   P1_1
+//#define IO_D6   P1_2
+//#define IO_D7   P1_3
 #endif
 
 #ifdef  LCD_BUS_8BIT
@@ -92,6 +126,22 @@
 #define IO_D    P2
 #endif
 
+// The UART in mode 0 shifts SBUF out on RXD (P3_0), clocked on TXD (P3_1), 8 bits in 8 machine cycles (4.3 us at
+// 22.1184 MHz), so the serial port is not available to the application. IO_SR_LATCH pulses RCLK once the byte is in.
+// SR_Q_xx are the 74HC595 outputs (Q0~Q7) wired to each LCD pin, P1 is not used.
+#ifdef  LCD_BUS_SR595
+#define IO_SR_LATCH P3_2
+#define SR_Q_D4     0
+#define SR_Q_D5     1
+#define SR_Q_D6     2
+#define SR_Q_D7     3
+#define SR_Q_RS     4
+#define SR_Q_E      5
+// #define SR_Q_BL     6           // Backlight transistor, if any: kept on
+#undef  IO_MODE_M68
+#undef  IO_MODE_I80
+#endif
+
 /*--------------------------End of user defined options----------------------------*/
 
 // Calculate delay cycles
@@ -123,6 +173,13 @@
 #endif
 #endif
 
+// The soft delays take uint8_t counts: stop here rather than wrap around on a fast core.
+#if INST_CYCLE_NS == 0
+#error "XTAL_FREQ/MCU_CYCLE above 1 GHz: the instruction cycle rounds to 0 ns."
+#elif INST_CYCLE_NS <= 500 && (1520000/INST_CYCLE_NS)/512 + 1 > 255
+#error "FN_DELAY_CLR does not fit in lcd_wait_512t(), check XTAL_FREQ and MCU_CYCLE."
+#endif
+
 // If read function available, check busy flag rather than soft delay
 
 #ifndef LCD_NO_READ
@@ -186,6 +243,9 @@ void lcd_wait();                // Wait for BF before write data
 void lcd_wait_2t(uint8_t);      // Soft delay, approximately 2*t instruction cycles
 void lcd_wait_512t(uint8_t);    // Delay approximately 2*256*t cycles
 void lcd_wait_65kt(uint8_t);    // Delay 2*65536*t
+#ifdef LCD_BUS_SR595
+void write_sr_init();           // Set the UART to mode 0 and clear the 74HC595
+#endif
 
 
 // Medium level functions, use these functions if you know the working process of the LCDs/VFDs well
@@ -220,7 +280,14 @@ void vfd_set_light_pt6314(uint8_t);                     // Set the lightness of
 
 // High level functions, recommended
 
+#if LCD_CONTROLLERS > 1
+#define DISP_ALL                0xFF
+void disp_select(uint8_t);                              // Select the controller (0 ~ LCD_CONTROLLERS-1) written to, or DISP_ALL
+#endif
+
 void disp_start(uint8_t, uint8_t);                      // Use this function to initialize the LCD if the power supply does not meet the requirements of power-on reset
+void disp_start_begin(uint8_t, uint8_t, uint16_t);      // Same as disp_start(), non-blocking: pass the time in ms (own timer), then
+uint8_t disp_start_step(uint16_t);                      // call this with the time in ms until it returns 1, before any other function
 void disp_clear();                                      // Clear LCD. Identical to lcd_clear()
 void disp_home();                                       // Cursor home. Identical to lcd_home()
 
@@ -240,4 +307,10 @@ void disp_curmov(uint8_t);                              // Move the cursor by on
 void disp_print(char);                                  // Print a single character
 void disp_println(const char *, uint8_t);               // Print line
 
-int disp_printf(const char *, ...);                     // Formattable print function, to support usage similar to printf()
\ No newline at end of file
+int disp_printf(const char *, ...);                     // Formattable print function, to support usage similar to printf()
+#ifdef LCD_SHADOW
+void disp_flush();                                      // Send the cells changed since the last flush
+#endif
+#ifdef LCD_CALIBRATE
+void disp_get_cal(uint8_t *, uint8_t *);                // LCD_CAL_CMD and LCD_CAL_CLR measured by disp_start(), 0 if unknown
+#endif
\ No newline at end of file
@@ -16,6 +16,10 @@ void main() {
         disp_printf("%s", "      ");
         disp_put_cur(1,10);
         disp_printf("%d", i);
+#ifdef LCD_SHADOW
+        // Only the digits that changed go out
+        disp_flush();
+#endif
     };
 
     while(1);
@@ -18,9 +18,10 @@
 // 8bit-bus-no-read:        Same as 8bit-bus mode with no read
 // 8bit-bus-port:           Same as 8bit-bus mode, but uses the whole group IO e.g. P2
 // 8bit-bus-port-no-read:   No read
+// xdata-bus:               i80 mode on the 8051 external memory bus: D0~D7 on P0, #WR/#RD strobed by MOVX, RS on an address line
 
 // Usage:
-// 1. Define your connection mode, available options are LCD_BUS_4BIT, LCD_BUS_8BIT or LCD_BUS_8P
+// 1. Define your connection mode, available options are LCD_BUS_4BIT, LCD_BUS_8BIT, LCD_BUS_8P or LCD_BUS_XDATA
 // 2. Define LCD_NO_READ if you do not use the read function, and soft delay will be used instead of waiting for the busy flag
 // 3. Change the definitions of IOs, XTAL_FREQ and MCU_CYCLE accordingly, this will be used in the calculation of delays later
 
@@ -56,8 +57,19 @@
 #define LCD_BUS_4BIT
 // #define LCD_BUS_8BIT
 // #define LCD_BUS_8P
+// #define LCD_BUS_XDATA
 
 // #define LCD_NO_READ
+// #define LCD_DEFERRED_WAIT       // Wait for the busy flag before the next access rather than after each command
+// #define LCD_CALIBRATE           // Time the busy flag at disp_start() (uses Timer0): disp_get_cal() gives the waits of this panel
+// #define LCD_CAL_CMD 0           // With LCD_NO_READ, the waits disp_get_cal() returned for this panel instead of the
+// #define LCD_CAL_CLR 0           // worst case ones (same XTAL_FREQ and MCU_CYCLE)
+// #define LCD_CALIBRATE_LOOPS     // Time the soft delay loops at disp_start() (uses Timer0): FN_DELAY_* right whatever MCU_CYCLE says
+// #define LCD_SHADOW              // Shadow screen: disp_* draw in it, disp_flush() sends what changed
+// #define LCD_SHADOW_ROWS 2       // Its geometry, 2x16 by default
+// #define LCD_SHADOW_COLS 16
+// #define LCD_SHADOW_IRAM 48      // Bytes of __idata the buffer (rows*columns*9/8) may take: a 20x4 needs an 8052
+                                   // with a higher limit and --iram-size 256, or LCD_SHADOW_MEM __xdata (not checked)
 
 /*----------Uncomment the following options to enable light adjust for VFDs----------*/
 
@@ -76,10 +88,15 @@
 #endif
 
 #ifdef  LCD_BUS_4BIT
-#define IO_D4   P1_0
-#define IO_D5   P1_1
-#define IO_D6   P1_2
-#define IO_D7   P1_3
+// D4~D7 on consecutive bits of one port: the port and the bit of D4 (0 to 4). IO_D4~IO_D7 follow from them
+// and the data line accesses are grouped into whole port operations. If the data pins are scattered,
+// comment out these two and define IO_D4~IO_D7 instead.
+#define IO_D_PORT   P1
+#define IO_D_SHIFT  0
+//#define IO_D4   P1_0
+//#define IO_D5   P1_1
+//#define IO_D6   P1_2
+//#define IO_D7   P1_3
 #endif
 
 #ifdef  LCD_BUS_8BIT
@@ -97,6 +114,19 @@
 #define IO_D    P2
 #endif
 
+// The LCD decoded in the external data space, like a memory chip behind the 74LS373 latch: the #WR (P3_6)
+// and #RD (P3_7) strobes come from MOVX, so the IO definitions above are not used. RS is wired to A0 here,
+// and the chip select decoded from A15. Define LCD_NO_READ if #RD is not wired.
+#ifdef  LCD_BUS_XDATA
+#define LCD_XDATA_CMD   0x8000  // RS = 0
+#define LCD_XDATA_DATA  0x8001  // RS = 1
+#undef  IO_MODE_M68
+#undef  IO_MODE_I80
+#undef  LCD_BUS_4BIT            // Always an 8 bit bus
+#undef  LCD_BUS_8BIT
+#undef  LCD_BUS_8P
+#endif
+
 /*--------------------------End of user defined options----------------------------*/
 
 // Calculate delay cycles
@@ -104,6 +134,19 @@
 // XTAL_FREQ=22118400 and MCU_CYCLE=12 means a 1-machine-cycle instruction taking ~542 ns to complete.
 #define INST_CYCLE_NS (MCU_CYCLE*(1000000000/XTAL_FREQ))
 
+// MOVX strobe width: 6 oscillator periods minus 100 ns in 12T mode (manual's external data memory timing).
+// The HD44780 needs 230 ns (PWEH), so in 12T mode the XTAL must be at most 18 MHz; 22.1184 MHz gives
+// about 171 ns. Define LCD_XDATA_STROBE_NS to the real width if the glue logic stretches the strobe
+// (a one-shot on E, or wait states from a 1T part's bus timing register).
+#ifdef LCD_BUS_XDATA
+#ifndef LCD_XDATA_STROBE_NS
+#define LCD_XDATA_STROBE_NS ((MCU_CYCLE/2)*(1000000000/XTAL_FREQ) - 100)
+#endif
+#if LCD_XDATA_STROBE_NS < 230
+#error "LCD_BUS_XDATA: the MOVX strobe is shorter than the 230 ns enable pulse of the HD44780. Lower XTAL_FREQ or stretch the strobe."
+#endif
+#endif
+
 #if INST_CYCLE_NS > 500
 
 #define FN_DELAY_PWRON          lcd_wait_512t((15000000/INST_CYCLE_NS)/512 + 1)     // Power on delay                     - uint8_t t = 30.296875 (function delays 53.763 ms, more than the 50 ms recommended by the HD44780U manual)
@@ -185,6 +228,13 @@
 #endif
 #endif
 
+// The soft delays take uint8_t counts: stop here rather than wrap around on a fast core.
+#if INST_CYCLE_NS == 0
+#error "XTAL_FREQ/MCU_CYCLE above 1 GHz: the instruction cycle rounds to 0 ns."
+#elif INST_CYCLE_NS <= 500 && (1520000/INST_CYCLE_NS)/512 + 1 > 255
+#error "FN_DELAY_CLR does not fit in lcd_wait_512t(), check XTAL_FREQ and MCU_CYCLE."
+#endif
+
 // If read function available, check busy flag rather than soft delay
 
 #ifndef LCD_NO_READ
@@ -283,6 +333,8 @@ void vfd_set_light_pt6314(uint8_t);                     // Set the lightness of
 // High level functions, recommended
 
 void disp_start(uint8_t, uint8_t);                      // Use this function to initialize the LCD if the power supply does not meet the requirements of power-on reset
+void disp_start_begin(uint8_t, uint8_t, uint16_t);      // Same as disp_start(), non-blocking: pass the time in ms (own timer), then
+uint8_t disp_start_step(uint16_t);                      // call this with the time in ms until it returns 1, before any other function
 void disp_clear();                                      // Clear LCD. Identical to lcd_clear()
 void disp_home();                                       // Cursor home. Identical to lcd_home()
 
@@ -302,4 +354,10 @@ void disp_curmov(uint8_t);                              // Move the cursor by on
 void disp_print(char);                                  // Print a single character
 void disp_println(const char *, uint8_t);               // Print line
 
-int disp_printf(const char *, ...);                     // Formattable print function, to support usage similar to printf()
\ No newline at end of file
+int disp_printf(const char *, ...);                     // Formattable print function, to support usage similar to printf()
+#ifdef LCD_SHADOW
+void disp_flush();                                      // Send the cells changed since the last flush
+#endif
+#ifdef LCD_CALIBRATE
+void disp_get_cal(uint8_t *, uint8_t *);                // LCD_CAL_CMD and LCD_CAL_CLR measured by disp_start(), 0 if unknown
+#endif
\ No newline at end of file
@@ -9,4 +9,50 @@
 
 // 3) The crystal oscillator/resonator speed (in Hz).
 #define XTAL_FREQ   22118400
-#define MCU_CYCLE   12
\ No newline at end of file
+#define MCU_CYCLE   12
+
+// 4) The I2C bus speed (in Hz): 100000 (Standard mode) up to 400000 (Fast mode).
+//    Uncomment I2C_CLOCK_STRETCH if a slave on the bus may hold SCL low.
+#define I2C_SPEED_HZ 100000
+// #define I2C_CLOCK_STRETCH
+
+// 5) Background transmission: uncomment to have the LCD bytes sent by a timer interrupt
+//    instead of blocking the caller (see ../src/i2cqueue.h for the other settings).
+// #define I2C_QUEUE
+// #define I2C_QUEUE_TIMER 0
+
+// 6) The backpack wiring (see ../src/hd44780_i2cbus.h): the common PCF8574 backpack by default,
+//    or uncomment one of these.
+// #define LCD_BACKPACK_MJKDZ
+// #define LCD_BACKPACK_MCP23008
+// #define LCD_BACKPACK_MCP23017
+
+// 7) Several displays on the same bus (ADDR is then unused): their number and I2C addresses.
+//    See lcdinitall() and lcdselect() in ../src/hd44780_i2cbus.h.
+// #define LCD_DISPLAYS 2
+// #define LCD_ADDRS    {0x27, 0x26}
+
+// 8) Other slaves on the same bus (EEPROM, RTC...): uncomment to schedule their transactions
+//    between the LCD characters (see ../src/i2csched.h). Not with I2C_QUEUE.
+// #define I2C_SCHED
+// #define LCD_I2C_PRIORITY 0
+
+// 9) Hardware timebase: uncomment to count milliseconds with a timer interrupt; delay_ms() then
+//    waits on it once tbinit() was called and EA set (see ../src/timebase.h). Not the I2C_QUEUE timer.
+//    TIMEBASE_TIMER_DIV: oscillator periods per timer count, 12 unless a 1T part runs its timers at XTAL.
+// #define TIMEBASE
+// #define TIMEBASE_TIMER 1
+// #define TIMEBASE_TIMER_DIV 12
+
+// 10) Uncomment to time the delay loops with Timer0 in delay_calibrate(), when MCU_CYCLE may not match the chip
+//     (1T derivatives): delay_ms() is then right without the timebase. Call it at startup, before lcdinit().
+// #define DELAY_CALIBRATE
+
+// 11) Shadow screen: uncomment to draw in a buffer with the lcdfb*() functions, and send only the
+//     cells changed with lcdfbflush() (see ../src/lcdfb.h). The buffer goes in __idata up to
+//     LCD_SHADOW_IRAM bytes (48): a 20x4 needs LCD_SHADOW_MEM __xdata, or an 8052 and --iram-size 256.
+// #define LCD_SHADOW
+// #define LCD_SHADOW_ROWS 4
+// #define LCD_SHADOW_COLS 20
+// #define LCD_SHADOW_MEM __xdata
+// #define LCD_SHADOW_IRAM 48
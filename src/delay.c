@@ -61,7 +61,8 @@ void delay_x100_cycles(uint8_t x100cycles)      // 2 cycles (lcall)
 }
 
 // ----------------------------------------------------------------
-void delay_ms(uint16_t ms)
+#ifndef DELAY_CALIBRATE
+static void delay_ms_cycles(uint16_t ms)
 {
 //    while(ms--)
 //        CALL_DELAY;
@@ -87,45 +88,86 @@ __asm
 delay_ms_lib_fin:
 __endasm;
 }
+#endif
+
+#ifdef DELAY_CALIBRATE
+// delay_x10_cycles() units per ms: the build time value until delay_calibrate() runs.
+static __data uint16_t _x10perms = (uint16_t)(__CYCLES_PER_MS/10);
+
+// The difference of two lengths cancels the calls, the loop and the timer start and stop.
+#define DELAY_CAL_REPS          8
+#define DELAY_CAL_LONG          250
+#define DELAY_CAL_SHORT         50
+#define DELAY_TICKS_PER_MS      ((XTAL_FREQ/DELAY_TIMER_DIV + 500)/1000)
+
+static uint16_t delay_cal_time(uint8_t x10cycles)
+{
+    uint8_t i;
+
+    TH0 = 0;
+    TL0 = 0;
+    TF0 = 0;
+    TR0 = 1;
+    for (i = 0; i < DELAY_CAL_REPS; i++)
+        delay_x10_cycles(x10cycles);
+    TR0 = 0;
+    return TF0 ? 0 : ((uint16_t)TH0 << 8) | TL0;
+}
+
+void delay_calibrate()
+{
+    uint8_t tmod = TMOD;
+    uint16_t tlong, tshort;
+    uint32_t units;
+
+    TMOD = (TMOD & 0xF0) | 0x01;
+    tshort = delay_cal_time(DELAY_CAL_SHORT);
+    tlong = delay_cal_time(DELAY_CAL_LONG);
+    TMOD = tmod;
+    // Keep the build time value if the timer overflowed
+    if (!tlong || tlong <= tshort)
+        return;
+    units = (uint32_t)DELAY_TICKS_PER_MS*(DELAY_CAL_REPS*(DELAY_CAL_LONG - DELAY_CAL_SHORT))/(tlong - tshort);
+    _x10perms = (units > 65535) ? 65535 : (units ? units : 1);
+}
 
-// Number of additional cycles for this function to take 5us to run: (2+1+X+2)*(1000000÷(CLOCK÷12)=5
-// (5+X)*(1000000÷(CLOCK÷12))=5
-// Examples:
-// (12       MHz) = (5+X)*(1000000÷(12000000÷12))=5 -> 5+X=5                      -> X=0
-// (16       MHz) = (5+X)*(1000000÷(16000000÷12))=5 -> 3.75+0.75X=5               -> X=1.666666667 (round to 2)
-// (18432000  Hz) = (5+X)*(1000000÷(18432000÷12))=5 -> 3.255208333+0.651041667X=5 -> X=2.679999999 (round to 3)
-// (20       MHz) = (5+X)*(1000000÷(20000000÷12))=5 -> 3.5+0.6X=5                 -> X=2.5         (round to 3)
-// (22118400  Hz) = (5+X)*(1000000÷(22118400÷12))=5 -> 2.71267361+0.542534722X=5  -> X=4.216000004 (round to 5)
-// (24       MHz) = (5+X)*(1000000÷(24000000÷12))=5 -> 2.5+0.5X=5                 -> X=5
-// (25       MHz) = (5+X)*(1000000÷(25000000÷12))=5 -> 2.4+0.48X=5                -> X=5.416666667 (round to 6)
-void delay_5us() __naked       // 2 cycle instruction (lcall _delay5us)
+static void delay_ms_cycles(uint16_t ms)
 {
-__asm__("nop");                // 1 cycle instruction (nop)
-#if XTAL_FREQ == 16000000      // X=1.666666667 (round to 2)
-__asm__("nop");                // 1 cycle instruction
-__asm__("nop");                // 1 cycle instruction
-#endif                         // X=2.679999999 (round to 3)
-#if XTAL_FREQ == 18432000 || XTAL_FREQ == 20000000
-__asm__("nop");                // 1 cycle instruction
-__asm__("nop");                // 1 cycle instruction
-__asm__("nop");                // 1 cycle instruction
-#endif                         // X=4.216000004 (round to 5)
-#if XTAL_FREQ == 22118400 || XTAL_FREQ == 24000000
-__asm__("nop");                // 1 cycle instruction
-__asm__("nop");                // 1 cycle instruction
-__asm__("nop");                // 1 cycle instruction
-__asm__("nop");                // 1 cycle instruction
-__asm__("nop");                // 1 cycle instruction
+    uint16_t n;
+
+    while (ms--) {
+        n = _x10perms;
+        while (n > 255) {
+            delay_x10_cycles(255);
+            n -= 255;
+        }
+        // delay_x10_cycles(0) would be 256 units
+        if (n)
+            delay_x10_cycles(n);
+    }
+}
 #endif
-#if XTAL_FREQ == 25000000      // X=5.416666667 (round to 6)
-__asm__("nop");                // 1 cycle instruction
-__asm__("nop");                // 1 cycle instruction
-__asm__("nop");                // 1 cycle instruction
-__asm__("nop");                // 1 cycle instruction
-__asm__("nop");                // 1 cycle instruction
-__asm__("nop");                // 1 cycle instruction
+
+// Against real time when the timebase runs, as the loop above is stretched by every interrupt.
+// Not while the interrupts are disabled: the tick would stop.
+void delay_ms(uint16_t ms)
+{
+#ifdef TIMEBASE
+    uint16_t deadline;
+
+    if (tbrunning && EA) {
+        deadline = tbdeadline(ms);
+        while (!tbexpired(deadline));
+        return;
+    }
+#endif
+    delay_ms_cycles(ms);
+}
+
+// 5 us or the next machine cycle, the caller's lcall (2 cycles) and the ret (2 cycles) included.
+void delay_5us()
+{
+#if DELAY_US_TO_CYCLES(5) > 4
+    delay_cycles(DELAY_US_TO_CYCLES(5) - 4);
 #endif
-__asm__("ret");                // 2 cycle instruction (ret)
 }
-                               // -----------------------------------
-                               // 5+X cycles             TOTAL
\ No newline at end of file
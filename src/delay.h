@@ -4,11 +4,39 @@
 */
 #include <stdint.h>
 #include "config.h"
+#include "timebase.h"
 
-#define CYCLES_PER_US(x) (x*1.0/(1000000.0/(XTAL_FREQ/MCU_CYCLE))+1)
-// Define directive to make it easier to understand and
-// automatically calculate the MCU cycles.
-#define DELAY_10_TIMES_US(x) delay_x10_cycles(CYCLES_PER_US(x))
+// Compile time delays for any XTAL_FREQ and MCU_CYCLE. delay_cycles(c) burns exactly 'c' machine
+// cycles, 'c' being a constant: up to 11 cycles are inlined NOPs, longer waits go through
+// delay_x100_cycles() and delay_x10_cycles() (100*x or 10*x cycles, plus 2 to load their argument)
+// followed by the remaining NOPs. Dead branches are removed by the compiler. The instruction
+// timings are those of the standard core, in machine cycles of MCU_CYCLE clock periods.
+// delay_us() and delay_ns_min() round up: the wait is never shorter than asked, and at most one
+// machine cycle longer (plus the code around it).
+#define DELAY_MCU_KHZ           ((XTAL_FREQ/MCU_CYCLE + 999)/1000)
+#define DELAY_US_TO_CYCLES(us)  (((us)*DELAY_MCU_KHZ + 999)/1000)
+#define DELAY_NS_TO_CYCLES(ns)  (((ns)*DELAY_MCU_KHZ + 999999)/1000000)
+#define DELAY_CYCLES_MAX        (255*100 + 2 + 99)
+
+#define DELAY_NOP()             __asm__("nop")
+#define DELAY_X100(c)           (((c) >= 112) ? ((c) - 2)/100 : 0)      // Calls of delay_x100_cycles()
+#define DELAY_R100(c)           (((c) >= 112) ? ((c) - 2)%100 : (c))    // Cycles left: 0..111
+#define DELAY_X10(r)            (((r) >= 12) ? ((r) - 2)/10 : 0)
+#define DELAY_R10(r)            (((r) >= 12) ? ((r) - 2)%10 : (r))      // NOPs: 0..11
+#define delay_cycles(c)                                                     \
+    do {                                                                    \
+        _Static_assert((c) >= 0 && (c) <= DELAY_CYCLES_MAX, "delay_cycles(): out of range, use delay_ms()"); \
+        if (DELAY_X100(c)) delay_x100_cycles(DELAY_X100(c));                \
+        if (DELAY_X10(DELAY_R100(c))) delay_x10_cycles(DELAY_X10(DELAY_R100(c))); \
+        if (DELAY_R10(DELAY_R100(c)) & 1) { DELAY_NOP(); }                  \
+        if (DELAY_R10(DELAY_R100(c)) & 2) { DELAY_NOP(); DELAY_NOP(); }     \
+        if (DELAY_R10(DELAY_R100(c)) & 4) { DELAY_NOP(); DELAY_NOP(); DELAY_NOP(); DELAY_NOP(); } \
+        if (DELAY_R10(DELAY_R100(c)) & 8) { DELAY_NOP(); DELAY_NOP(); DELAY_NOP(); DELAY_NOP(); DELAY_NOP(); DELAY_NOP(); DELAY_NOP(); DELAY_NOP(); } \
+    } while (0)
+#define delay_us(us)            delay_cycles(DELAY_US_TO_CYCLES(us))
+#define delay_ns_min(ns)        delay_cycles(DELAY_NS_TO_CYCLES(ns))
+
+#define DELAY_10_TIMES_US(x)    delay_us(10*(x))
 
 #define INST_CYCLE_NS (MCU_CYCLE*(1000000000/XTAL_FREQ))
 
@@ -25,7 +53,18 @@
 #define FN_DELAYT_R_END  DELAY_10_TIMES_US(1)
 #endif
 
+// With DELAY_CALIBRATE (config.h), delay_calibrate() times delay_x10_cycles() against Timer0, and delay_ms()
+// then loops as long as this chip needs per ms, whatever MCU_CYCLE says. Call it first, before the other users
+// of the timers. Timer0 counts XTAL_FREQ/DELAY_TIMER_DIV: 12 on the standard core, and by default on the 1T
+// derivatives, the same as TIMEBASE_TIMER_DIV (timebase.h). The compile time delays above are not affected.
+#ifdef DELAY_CALIBRATE
+#ifndef DELAY_TIMER_DIV
+#define DELAY_TIMER_DIV         TIMEBASE_TIMER_DIV
+#endif
+extern void delay_calibrate();
+#endif
+
 extern void delay_x10_cycles(uint8_t x10cycles);
 extern void delay_x100_cycles(uint8_t x100cycles);
-extern void delay_ms(uint16_t ms);
+extern void delay_ms(uint16_t ms);             // With TIMEBASE, waits on millis() once tbinit() was called
 extern void delay_5us();
\ No newline at end of file
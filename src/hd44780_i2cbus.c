@@ -19,146 +19,717 @@ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 #include "delay.h"
 #include "hd44780_i2cbus.h"
 #include "i2c.h"
+#include "i2cqueue.h"
+#include "i2csched.h"
 
-static unsigned char _displayfn =    LCD1602_4BITMODE    | LCD1602_1LINE     | LCD1602_5x8DOTS;
+// The HD44780 logic below is shared by the backpacks: it talks to the expander through the lcdx*()
+// transport of hd44780_i2cbus.h, implemented further down for the PCF8574 and MCP23008 (4 bit
+// mode), and in hd44780_i2cbus_mcp23017.c for the MCP23017 (8 bit mode).
+
+static unsigned char _displayfn =    LCD_XBITMODE        | LCD1602_1LINE     | LCD1602_5x8DOTS;
 static unsigned char _displayctrl =  LCD1602_DISPLAYON   | LCD1602_CURSOROFF | LCD1602_BLINKOFF;
 static unsigned char _displaymode =  LCD1602_ENTRYLEFT   | LCD1602_ENTRYSHIFTDEC;
-static unsigned char _backlight =    LCD1602_BACKLIGHT;
+unsigned char lcdxbacklight =        LCD1602_BACKLIGHT;
+// Address counter of the controller as its set DDRAM address command, 0 when unknown (in CGRAM,
+// or after a resync): moving the cursor where it already is sends nothing, and lcdgetcursor()
+// answers without reading the display.
+static unsigned char _ac = 0;
+// Set when the backpack did not acknowledge a byte (unplugged, brown out): the traffic stops
+// until it answers again, see lcdpresent().
+unsigned char lcdxabsent = 0;
+// Set by a resync, until lcdresynced() reads it.
+static unsigned char _resynced = 0;
 
-static void expanderwrite(unsigned char value)
+#ifndef LCD_BACKPACK_MCP23017
+
+// A PCF8574 latches every data byte of a write transaction on its outputs,
+// so the nibble and enable-strobe bytes of a character (or of a whole string)
+// can be streamed inside a single transaction: one start, one address byte
+// and one stop instead of one full transaction per expander byte.
+#ifdef I2C_QUEUE
+// Bytes are queued for the timer interrupt, which opens and closes the transactions itself
+// (and sends the MCP23008 register byte, see I2C_QUEUE_PREFIX in i2cqueue.h).
+static void expanderstart()
+{}
+
+// The ISR empties the queue on a NAK: nothing more is queued until lcdpresent() clears i2cqnak.
+static void expanderput(unsigned char value)
+{
+    if (!i2cqnak)
+        while (!i2cqput(value));
+}
+
+static void expanderstop()
+{}
+#else
+static void expanderput(unsigned char value)
+{
+    if (!lcdxabsent && i2csend(value))
+        lcdxabsent = 1;
+}
+
+static void expanderstart()
 {
     i2cstart();
-    i2csendaddr();
-    i2csend(value | _backlight);
-    i2cstop();
+    if (i2csendaddr())
+        lcdxabsent = 1;
+#ifdef LCD_BACKPACK_MCP23008
+    // Sequential operation is disabled: every following byte is written to OLAT.
+    expanderput(MCP23008_OLAT);
+#endif
 }
 
-inline void pulseenable(unsigned char value)
+static void expanderstop()
+{i2cstop();}
+#endif
+
+static void expandersend(unsigned char value)
+{expanderput(value | lcdxbacklight);}
+
+// Waits until every queued byte reached the expander: required before timed waits and bus reads.
+void lcdxflush()
 {
-    expanderwrite(value | En);
-#ifdef FAST_MCU
+#ifdef I2C_QUEUE
+    i2cqflush();
+#endif
+}
+
+// Whether a byte was not acknowledged since the last lcdpresent().
+unsigned char lcdxmissing()
+{
+#ifdef I2C_QUEUE
+    if (i2cqnak)
+        lcdxabsent = 1;
+#endif
+    return lcdxabsent;
+}
+
+// Lets the transactions of the other slaves above LCD_I2C_PRIORITY (I2C_SCHED) use the bus:
+// closes the expander transaction, runs them, and opens it again. The expander outputs,
+// E low included, are unchanged meanwhile.
+static void expanderyield()
+{
+#ifdef I2C_SCHED
+    if (i2cxtop > LCD_I2C_PRIORITY) {
+        expanderstop();
+        i2cxrun(LCD_I2C_PRIORITY);
+        expanderstart();
+    }
+#endif
+}
+
+// The expander bytes of a nibble write are looked up rather than assembled with shifts and ORs:
+// the tables are indexed by nibble | LCD_XRS | LCD_XIDX_BL and built at compile time from the
+// backpack descriptor in hd44780_i2cbus.h (Rs, En, D4..D7, backlight pin). RW stays low.
+// LCD_XIDX_BL sets the backlight pin high, which is "off" on backpacks where it is active low.
+#define LCD_XIDX_BL             0x20
+#define LCD_XBL                 (LCD1602_BACKLIGHT | LCD1602_NOBACKLIGHT)
+
+#define LCD_XNIBBLE(i)          ((((i) & 0x01) ? D4 : 0) | (((i) & 0x02) ? D5 : 0) | \
+                                 (((i) & 0x04) ? D6 : 0) | (((i) & 0x08) ? D7 : 0))
+#define LCD_XBYTE(i)            (LCD_XNIBBLE(i) | (((i) & LCD_XRS) ? Rs : 0) | \
+                                 (((i) & LCD_XIDX_BL) ? LCD_XBL : 0))
+#define LCD_XROW4(i, e)         LCD_XBYTE(i) | (e), LCD_XBYTE((i) + 1) | (e), \
+                                LCD_XBYTE((i) + 2) | (e), LCD_XBYTE((i) + 3) | (e)
+#define LCD_XROW16(i, e)        LCD_XROW4(i, e), LCD_XROW4((i) + 4, e), \
+                                LCD_XROW4((i) + 8, e), LCD_XROW4((i) + 12, e)
+#define LCD_XTABLE(e)           { LCD_XROW16(0x00, e), LCD_XROW16(0x10, e), \
+                                  LCD_XROW16(0x20, e), LCD_XROW16(0x30, e) }
+
+static __code unsigned char _xelow[64] = LCD_XTABLE(0);
+static __code unsigned char _xehigh[64] = LCD_XTABLE(En);
+
+#ifdef LCD_TWOBYTE_NIBBLE
+// Every expander byte is latched by the PCF8574 on its own ACK clock, 9 SCL periods after the
+// previous one. With E raised together with the nibble and dropped in the next byte:
+// - E high width (PWEH >= 230 ns) and data setup before E falls (tDSW >= 80 ns) last one byte;
+// - data hold after E falls (tH >= 10 ns) is kept, as the E low byte repeats the nibble;
+// - the enable cycle (tcycE >= 500 ns) lasts two bytes;
+// - RS setup before E rises (tAS >= 40 ns) is kept by an extra setup byte, sent only when RS changes;
+// - the next E rise comes at least one byte after the last E fall of a character, padded below
+//   with repeated E low bytes when that is shorter than the 37 us execution time.
+#define LCD_I2C_BYTE_NS         (9*(I2C_TLOW_NS + I2C_THIGH_NS))
+#define LCD_TEXEC_NS            37000
+
+#if LCD_I2C_BYTE_NS < 230 || 2*LCD_I2C_BYTE_NS < 500
+#error "LCD_TWOBYTE_NIBBLE: the I2C bus is too fast for the HD44780 enable pulse timing."
+#endif
+
+#if LCD_I2C_BYTE_NS < LCD_TEXEC_NS
+#define LCD_TEXEC_PAD_BYTES     ((LCD_TEXEC_NS + LCD_I2C_BYTE_NS - 1)/LCD_I2C_BYTE_NS - 1)
+#endif
+
+// RS level left on the expander, as LCD_XRS or 0.
+static unsigned char _lastrs = 0xFF;
+#endif
+
+static void expanderwrite(unsigned char value)
+{
+#ifdef LCD_TWOBYTE_NIBBLE
+    _lastrs = (value & Rs) ? LCD_XRS : 0;
+#endif
+    expanderstart();
+    expandersend(value);
+    expanderstop();
+}
+
+void lcdxidle()
+{expanderwrite(0);}
+
+// The following functions only stream bytes: the caller opens and closes the transaction.
+// index is nibble | LCD_XRS | LCD_XIDX_BL, see the tables above.
+#ifdef LCD_TWOBYTE_NIBBLE
+// Two bytes per nibble: nibble|RS|BL|E, then nibble|RS|BL.
+static void write4bits(unsigned char index)
+{
+    if ((index & LCD_XRS) != _lastrs) {
+        _lastrs = index & LCD_XRS;
+        expanderput(_xelow[index]);
+    }
+    expanderput(_xehigh[index]);
+#if defined(FAST_MCU) && !defined(I2C_QUEUE)
     FN_DELAYT_W_EH;
 #endif
-    expanderwrite(value | ~En);
-#ifdef FAST_MCU
+    expanderput(_xelow[index]);
+#if defined(FAST_MCU) && !defined(I2C_QUEUE)
     FN_DELAYT_W_END;
 #endif
 }
-
-static void write4bits(unsigned char value)
+#else
+// Three bytes per nibble: setup, E high, E low.
+static void write4bits(unsigned char index)
 {
-    expanderwrite(value);
-    pulseenable(value);
+    expanderput(_xelow[index]);
+    expanderput(_xehigh[index]);
+#if defined(FAST_MCU) && !defined(I2C_QUEUE)
+    FN_DELAYT_W_EH;
+#endif
+    expanderput(_xelow[index]);
+#if defined(FAST_MCU) && !defined(I2C_QUEUE)
+    FN_DELAYT_W_END;
+#endif
 }
+#endif
 
-#ifdef LCD_READ_ENABLED
-void lcdwaitforbusyflag()
+// A single nibble (instruction register) in its own transaction, for the initialization sequence.
+void lcdxnibble(unsigned char nibble)
 {
-                                                    // See HD44780U manual, page 24.
-                                                    // BL = Backlight
-                                                    // P7 P6 P5 P4 P3 EN RW RS
-    static const unsigned char READ_EN_RISE = 0xF6; // 1  1  1  1  BL 1  1  0
-    static const unsigned char READ_EN_FALL = 0xF2; // 1  1  1  1  BL 0  1  0
-    unsigned char add = 0x00;
+    expanderstart();
+    write4bits(nibble | (lcdxbacklight ? LCD_XIDX_BL : 0));
+    expanderstop();
+}
 
-    // Bit banging, following the instructions in the HD44780U manual, page 33.
-    while(add & BF)
-    {
-        write4bits(READ_EN_FALL);
-#ifdef FAST_MCU
-        FN_DELAYT_R_RS2E;
+// rs, the register of the first byte, only matters to the 8 bit transport.
+void lcdxbegin(unsigned char rs)
+{expanderstart();}
+
+void lcdxend()
+{expanderstop();}
+
+// rs is either 0 (instruction register) or LCD_XRS (data register).
+void lcdxwrite(unsigned char value, unsigned char rs)
+{
+    if (lcdxbacklight)
+        rs |= LCD_XIDX_BL;
+    write4bits((value >> 4) | rs);
+    rs |= value & 0x0f;
+    write4bits(rs);
+#ifdef LCD_TEXEC_PAD_BYTES
+    for (unsigned char i = 0; i < LCD_TEXEC_PAD_BYTES; i++)
+        expanderput(_xelow[rs]);
 #endif
-        add = (i2cread() >> 7);
-        write4bits(READ_EN_RISE);
-#ifdef FAST_MCU
-        FN_DELAYT_R_E2D;
+    // Character boundary.
+    expanderyield();
+}
+
+void lcdxcommand(unsigned char value)
+{
+    expanderstart();
+    lcdxwrite(value, 0);
+    expanderstop();
+}
+
+void lcdxdata(unsigned char value)
+{
+    expanderstart();
+    lcdxwrite(value, LCD_XRS);
+    expanderstop();
+}
+
+#ifdef LCD_BACKPACK_MCP23008
+// Register write, before the LCD traffic starts (and before the I2C_QUEUE transmitter runs).
+static void mcp23008write(unsigned char reg, unsigned char value)
+{
+    i2cstart();
+    i2csendaddr();
+    i2csend(reg);
+    i2csend(value);
+    i2cstop();
+}
 #endif
-        add = (i2cread() >> 7);
-        write4bits(READ_EN_FALL);
-#ifdef FAST_MCU
-        FN_DELAYT_R_END;
+
+void lcdxsetup()
+{
+#ifdef LCD_BACKPACK_MCP23008
+    mcp23008write(MCP23008_IOCON, MCP23008_SEQOP);
+    mcp23008write(MCP23008_IODIR, 0x00);    // All pins outputs
 #endif
-        add = (i2cread() >> 7);
-        write4bits(READ_EN_RISE);
+}
+
+#ifdef LCD_READ_ENABLED
+// Bounds the wait when the backpack does not answer: an absent PCF8574 reads as 0xFF, i.e. busy.
+#define LCD_BF_MAXPOLLS         255
+
+// Read strobes, see HD44780U manual, page 24: RW high, D7..D4 released (high) so the LCD drives them.
+#define LCD_XDATA               (D4 | D5 | D6 | D7)
+#define READ_IR_EN_RISE         (LCD_XDATA | Rw | En)
+#define READ_IR_EN_FALL         (LCD_XDATA | Rw)
+#define READ_DR_EN_RISE         (LCD_XDATA | Rw | En | Rs)
+#define READ_DR_EN_FALL         (LCD_XDATA | Rw | Rs)
+
+// Expander data pins to a nibble value.
+#define LCD_XDECODE(v)          ((((v) & D4) ? 0x01 : 0) | (((v) & D5) ? 0x02 : 0) | \
+                                 (((v) & D6) ? 0x04 : 0) | (((v) & D7) ? 0x08 : 0))
+
+// Raises E, reads the nibble the LCD drives on D7..D4 after a repeated start with the read
+// address, then goes back to writing and drops E. Runs inside an open write transaction.
+static unsigned char readnibble(unsigned char rise)
+{
+    unsigned char value;
+
+    i2csend(rise | lcdxbacklight);
 #ifdef FAST_MCU
-        FN_DELAYT_R_E2D;
+    FN_DELAYT_R_E2D;
 #endif
-        add = (i2cread() >> 7);
-        write4bits(READ_EN_FALL);
-#ifdef FAST_MCU
-        FN_DELAYT_R_END;
+    i2crestart();
+    if (i2csendreadaddr())
+        lcdxabsent = 1;
+    value = i2cread();
+    i2cnak();
+    i2crestart();
+    i2csendaddr();
+    i2csend((rise & ~En) | lcdxbacklight);
+    return value & LCD_XDATA;
+}
+
+// Polls the busy flag within a single I2C transaction until it clears.
+// The reads go straight to the bus, bypassing the I2C_QUEUE transmitter (which is flushed first).
+void lcdwaitforbusyflag()
+{
+    unsigned char polls = LCD_BF_MAXPOLLS;
+    unsigned char status;
+
+    lcdxflush();
+    if (lcdxmissing())
+        return;
+    i2cstart();
+    lcdxabsent = i2csendaddr();
+    i2csend(READ_IR_EN_FALL | lcdxbacklight);
+    // Bit banging, following the instructions in the HD44780U manual, page 33.
+    do {
+        status = readnibble(READ_IR_EN_RISE);       // High nibble: BF, AC6..AC4
+        i2csend(READ_IR_EN_RISE | lcdxbacklight);   // Low nibble: AC3..AC0, not needed
+        i2csend(READ_IR_EN_FALL | lcdxbacklight);
+        expanderyield();
+    } while ((status & BF) && !lcdxabsent && --polls);
+    i2cstop();
+#ifdef LCD_TWOBYTE_NIBBLE
+    // The latch is left with RW high: the next write sends its setup byte first (tAS)
+    _lastrs = 0xFF;
 #endif
-        add = (i2cread() >> 7);
+}
+
+// Reads n characters at the address counter in a single I2C transaction (repeated starts between
+// the nibble reads).
+void lcdxread(unsigned char buf[], unsigned char n)
+{
+    unsigned char high, low;
+
+    lcdxflush();
+    if (lcdxmissing())
+        return;
+    i2cstart();
+    lcdxabsent = i2csendaddr();
+    i2csend(READ_DR_EN_FALL | lcdxbacklight);
+    while (!lcdxabsent && n--) {
+        high = readnibble(READ_DR_EN_RISE);
+        low = readnibble(READ_DR_EN_RISE);
+        *buf++ = (LCD_XDECODE(high) << 4) | LCD_XDECODE(low);
     }
+    i2cstop();
+#ifdef LCD_TWOBYTE_NIBBLE
+    // As after lcdwaitforbusyflag(): RW still high on the latch
+    _lastrs = 0xFF;
+#endif
 }
 #endif
 
-static void command(unsigned char value)
+#endif // LCD_BACKPACK_MCP23017
+
+#if LCD_DISPLAYS > 1
+static __code unsigned char _addrs[LCD_DISPLAYS] = LCD_ADDRS;
+
+// State of the displays, saved while another one is selected.
+static struct {
+    unsigned char displayfn;
+    unsigned char displayctrl;
+    unsigned char displaymode;
+    unsigned char backlight;
+    unsigned char absent;
+    unsigned char resynced;
+    unsigned char ac;
+#ifdef LCD_TWOBYTE_NIBBLE
+    unsigned char lastrs;
+#endif
+} _lcd[LCD_DISPLAYS];
+static unsigned char _current = 0;
+
+// The functions below work on file statics, so switching displays swaps them: the per call
+// cost stays the same as with a single display.
+void lcdselect(unsigned char display)
 {
-    write4bits(value & 0xf0);
-    write4bits((value << 4) & 0xf0);
+    if (display == _current)
+        return;
+    // Queued bytes belong to the current display.
+    lcdxflush();
+    _lcd[_current].displayfn = _displayfn;
+    _lcd[_current].displayctrl = _displayctrl;
+    _lcd[_current].displaymode = _displaymode;
+    _lcd[_current].backlight = lcdxbacklight;
+    _lcd[_current].absent = lcdxabsent;
+    _lcd[_current].resynced = _resynced;
+    _lcd[_current].ac = _ac;
+#ifdef LCD_TWOBYTE_NIBBLE
+    _lcd[_current].lastrs = _lastrs;
+#endif
+    _current = display;
+    _displayfn = _lcd[display].displayfn;
+    _displayctrl = _lcd[display].displayctrl;
+    _displaymode = _lcd[display].displaymode;
+    lcdxbacklight = _lcd[display].backlight;
+    lcdxabsent = _lcd[display].absent;
+    _resynced = _lcd[display].resynced;
+    _ac = _lcd[display].ac;
+#ifdef LCD_TWOBYTE_NIBBLE
+    _lastrs = _lcd[display].lastrs;
+#endif
+    i2csetaddr(_addrs[display]);
 }
+#else
+#define lcdselect(display)
+#endif
 
-static void data(unsigned char value)
+// The address counter after a character written or read, following the entry mode. In 2 line mode
+// DDRAM goes on from 0x27 to 0x40, and from 0x67 to 0x00.
+static void acnext()
 {
-    write4bits((value & 0xf0) | Rs);
-    write4bits(((value << 4) & 0xf0) | Rs);
+    unsigned char a = _ac & 0x7F;
+
+    if (!_ac)
+        return;
+    if (_displaymode & LCD1602_ENTRYLEFT) {
+        if (_displayfn & LCD1602_2LINE)
+            a = (a == 0x27) ? 0x40 : (a == 0x67) ? 0x00 : a + 1;
+        else
+            a = (a == 0x4F) ? 0x00 : a + 1;
+    }
+    else {
+        if (_displayfn & LCD1602_2LINE)
+            a = (a == 0x40) ? 0x27 : (a == 0x00) ? 0x67 : a - 1;
+        else
+            a = (a == 0x00) ? 0x4F : a - 1;
+    }
+    _ac = LCD1602_SETDDRAMADDR | a;
 }
 
-void lcdinit(
+// The settings of lcdinit(), the bus width being that of the transport.
+static void initsettings(
     unsigned char displayfn,
     unsigned char displayctrl,
     unsigned char displaymode,
     unsigned char backlight
     )
 {
-    _displayfn = displayfn;
+    _displayfn = (displayfn & ~LCD1602_8BITMODE) | LCD_XBITMODE;
     _displayctrl = displayctrl;
     _displaymode = displaymode;
-    _backlight = backlight;
+    lcdxbacklight = backlight;
+}
+
+// Bus and expander setup for the displays first..last.
+static void initbus(unsigned char first, unsigned char last)
+{
+    unsigned char d;
 
     i2cinit();
+#if LCD_DISPLAYS > 1
+    i2csetaddr(_addrs[_current]);
+#endif
+    for (d = first; d <= last; d++) {
+        lcdselect(d);
+        lcdxsetup();
+    }
+#ifdef I2C_QUEUE
+    i2cqinit();
+#endif
+}
+
+// One step of the initialization sequence (HD44780U manual, page 46), for the selected display.
+// The 8 bit transports send the 0x03 nibbles as whole function sets, and skip the 0x02 one.
+static void initstep(unsigned char step)
+{
+    switch (step) {
+        case 0:
+            lcdxidle();
+            _ac = 0;
+            break;
+        case 1:
+        case 2:
+        case 3:
+            lcdxnibble(0x03);
+            break;
+        case 4:
+            lcdxnibble(0x02);
+            lcdxcommand(LCD1602_FUNCTIONSET | _displayfn);
+            _displayctrl |= LCD1602_DISPLAYON;
+            lcdxcommand(LCD1602_DISPLAYCONTROL | _displayctrl);
+            lcdxcommand(LCD1602_CLEARDISPLAY);
+            break;
+        default:
+            lcdxcommand(LCD1602_ENTRYMODESET | _displaymode);
+            lcdxcommand(LCD1602_RETURNHOME);
+            _ac = LCD1602_SETDDRAMADDR;
+            break;
+    }
+}
+
+#define LCD_INIT_STEPS          6
+
+// Initializes the displays first..last step by step: each step is sent to all of them, then the
+// step wait runs once, so several displays take about the time of one (~110 ms).
+static void initdisplays(unsigned char first, unsigned char last)
+{
+    unsigned char step, d;
+
     delay_ms(50);
-    expanderwrite(_backlight);
-    delay_ms(50);
-    write4bits(0x03 << 4);
-    // > 4.1 ms
-    delay_ms(5);
-    write4bits(0x03 << 4);
-    // > 4.1 ms
-    delay_ms(5);
-    write4bits(0x03 << 4);
+    for (step = 0; step < LCD_INIT_STEPS; step++) {
+        for (d = first; d <= last; d++) {
+            lcdselect(d);
+            initstep(step);
+        }
+        lcdxflush();
+        switch (step) {
+            case 0:
+                delay_ms(50);
+                break;
+            case 1:
+            case 2:
+                // > 4.1 ms
+                delay_ms(5);
+                break;
+            case 3:
+                // > 150 us. The busy flag cannot be checked before the function set.
+                DELAY_10_TIMES_US(16); // 160 us
+                break;
+            default:
+                // Clear display, return home: > 1.52 ms
 #ifdef LCD_READ_ENABLED
-    lcdwaitforbusyflag();
+                for (d = first; d <= last; d++) {
+                    lcdselect(d);
+                    lcdwaitforbusyflag();
+                }
+#else
+                delay_ms(2);
+#endif
+                break;
+        }
+    }
+}
+
+// Initializes the selected display (the only one unless LCD_DISPLAYS > 1).
+void lcdinit(
+    unsigned char displayfn,
+    unsigned char displayctrl,
+    unsigned char displaymode,
+    unsigned char backlight
+    )
+{
+    unsigned char d = 0;
+
+    initsettings(displayfn, displayctrl, displaymode, backlight);
+#if LCD_DISPLAYS > 1
+    d = _current;
+#endif
+    initbus(d, d);
+    initdisplays(d, d);
+}
+
+#if LCD_DISPLAYS > 1
+// Initializes all the displays with the same settings, interleaved. Display 0 is left selected.
+void lcdinitall(
+    unsigned char displayfn,
+    unsigned char displayctrl,
+    unsigned char displaymode,
+    unsigned char backlight
+    )
+{
+    unsigned char d;
+
+    for (d = 0; d < LCD_DISPLAYS; d++) {
+        lcdselect(d);
+        initsettings(displayfn, displayctrl, displaymode, backlight);
+#ifdef LCD_TWOBYTE_NIBBLE
+        _lastrs = 0xFF;
+#endif
+    }
+    initbus(0, LCD_DISPLAYS - 1);
+    initdisplays(0, LCD_DISPLAYS - 1);
+    lcdselect(0);
+}
+#endif
+
+// Non-blocking lcdinit(): lcdinitbegin() sets up the bus, then each lcdinitstep() call sends
+// the next step of initdisplays() once the wait of the previous one is over, and returns 1 when
+// the display is ready. now_ms is any free running millisecond count (it may wrap around). A
+// deadline is one ms more than the wait, as the count may tick right after it is read; the
+// busy flag is not polled. Both work on the selected display and each display keeps its own
+// step, so several can be initialized at once: select each one in turn for lcdinitbegin(),
+// then for lcdinitstep() until all return 1. Other displays can be used between two steps.
+static __code unsigned char _initwaits[LCD_INIT_STEPS] = {50, 5, 5, 1, 2, 2};
+#if LCD_DISPLAYS > 1
+static unsigned char _initnext[LCD_DISPLAYS];   // Next step + 1, 0 when done
+static unsigned int _initdeadline[LCD_DISPLAYS];
+#define INIT_D                  _current
 #else
-    // > 150 us
+static unsigned char _initnext[1];
+static unsigned int _initdeadline[1];
+#define INIT_D                  0
+#endif
+
+void lcdinitbegin(
+    unsigned char displayfn,
+    unsigned char displayctrl,
+    unsigned char displaymode,
+    unsigned char backlight,
+    unsigned int now_ms
+    )
+{
+    initsettings(displayfn, displayctrl, displaymode, backlight);
+#ifdef LCD_TWOBYTE_NIBBLE
+    _lastrs = 0xFF;
+#endif
+    initbus(INIT_D, INIT_D);
+    _initnext[INIT_D] = 1;
+    _initdeadline[INIT_D] = now_ms + 50 + 1;
+}
+
+unsigned char lcdinitstep(unsigned int now_ms)
+{
+    unsigned char step;
+
+    if (!_initnext[INIT_D])
+        return 1;
+    if ((int)(now_ms - _initdeadline[INIT_D]) < 0)
+        return 0;
+    if (_initnext[INIT_D] > LCD_INIT_STEPS) {
+        // Last wait over
+        _initnext[INIT_D] = 0;
+        return 1;
+    }
+    step = _initnext[INIT_D]++ - 1;
+    initstep(step);
+    lcdxflush();
+    _initdeadline[INIT_D] = now_ms + _initwaits[step] + 1;
+    return 0;
+}
+
+// Minimal initialization once the backpack answers again: its outputs, and maybe the LCD, were
+// reset. The 0x03 nibbles bring the LCD back to 8 bit mode from any state (even between the two
+// nibbles of a byte), then the bus width and the settings are replayed. DDRAM is left as it is.
+static void lcdresync()
+{
+    lcdxsetup();
+    lcdxidle();
+    lcdxnibble(0x03);
+    lcdxflush();
+    // > 4.1 ms, in case the LCD was reset too
+    delay_ms(5);
+    lcdxnibble(0x03);
+    lcdxflush();
+    DELAY_10_TIMES_US(16); // 160 us
+    lcdxnibble(0x03);
+    lcdxflush();
     DELAY_10_TIMES_US(16); // 160 us
+    lcdxnibble(0x02);
+    lcdxcommand(LCD1602_FUNCTIONSET | _displayfn);
+    lcdxcommand(LCD1602_DISPLAYCONTROL | _displayctrl);
+    lcdxcommand(LCD1602_ENTRYMODESET | _displaymode);
+    _ac = 0;
+}
+
+// Returns 1 when the backpack of the selected display answers. While it does not, the functions
+// below return at once, costing a single address byte (this probe) per call, and 0 is returned.
+// When it answers again, the display is resynchronized first and 2 is returned: its DDRAM may
+// have been lost, the caller should redraw it. As the other functions call lcdpresent() too,
+// the resync is also latched for lcdresynced().
+unsigned char lcdpresent()
+{
+#ifdef I2C_QUEUE
+    if (i2cqnak) {
+        i2cqflush();
+        i2cqnak = 0;
+        lcdxabsent = 1;
+    }
 #endif
-    write4bits(0x02 << 4);
+    if (!lcdxabsent)
+        return 1;
+    i2cstart();
+    lcdxabsent = i2csendaddr();
+    i2cstop();
+    if (lcdxabsent)
+        return 0;
+    lcdresync();
+    if (lcdxmissing())
+        return 0;
+    _resynced = 1;
+    return 2;
+}
+
+// 1 once after each resync of the selected display, wherever it happened.
+unsigned char lcdresynced()
+{
+    unsigned char r = _resynced;
 
-    command(LCD1602_FUNCTIONSET | _displayfn);
-    lcddisplayon();
-    lcdclear();
-    command(LCD1602_ENTRYMODESET | _displaymode);
-    lcdhome();
+    _resynced = 0;
+    return r;
 }
 
 void lcdclear()
 {
-    command(LCD1602_CLEARDISPLAY);
+    if (!lcdpresent())
+        return;
+    lcdxcommand(LCD1602_CLEARDISPLAY);
+    // The clear also sets the increment mode
+    _ac = LCD1602_SETDDRAMADDR;
+    _displaymode |= LCD1602_ENTRYLEFT;
 #ifdef LCD_READ_ENABLED
     lcdwaitforbusyflag();
 #else
+    lcdxflush();
     delay_ms(2);
 #endif
 }
 
 void lcdhome()
 {
-    command(LCD1602_RETURNHOME);
+    if (!lcdpresent())
+        return;
+    lcdxcommand(LCD1602_RETURNHOME);
+    _ac = LCD1602_SETDDRAMADDR;
 #ifdef LCD_READ_ENABLED
     lcdwaitforbusyflag();
 #else
+    lcdxflush();
     delay_ms(2);
 #endif
 }
@@ -182,55 +753,131 @@ void lcdsetcursor(unsigned char col, unsigned char row)
                 break;
             }
 
-    command(LCD1602_SETDDRAMADDR | addr);
+    addr |= LCD1602_SETDDRAMADDR;
+    if (!lcdpresent() || addr == _ac)
+        return;
+    lcdxcommand(addr);
+    _ac = addr;
 }
 
-void lcddisplayon()
+// Cursor position from the model, without any bus traffic: returns 0 when it is not known (after
+// lcdcreatechar() or a resync, until lcdsetcursor()). Rows 2 and 3 are those of a 20x4.
+unsigned char lcdgetcursor(unsigned char *col, unsigned char *row)
 {
-    _displayctrl != LCD1602_DISPLAYON;
-    command(LCD1602_DISPLAYCONTROL | _displayctrl);
+    unsigned char a = _ac & 0x7F;
+
+    if (!_ac)
+        return 0;
+    *row = 0;
+    if (_displayfn & LCD1602_2LINE) {
+        if (a >= 0x40) {
+            *row = 1;
+            a -= 0x40;
+        }
+        if (a >= 0x14) {
+            *row += 2;
+            a -= 0x14;
+        }
+    }
+    *col = a;
+    return 1;
 }
 
-void lcddisplayoff()
+// Sends the display control only when it changes. While the backpack does not answer the new
+// state is kept, and lcdresync() replays it.
+static void displaycontrol(unsigned char ctrl)
 {
-    _displayctrl &= ~LCD1602_DISPLAYON;
-    command(LCD1602_DISPLAYCONTROL | _displayctrl);
+    if (ctrl == _displayctrl)
+        return;
+    _displayctrl = ctrl;
+    if (lcdpresent())
+        lcdxcommand(LCD1602_DISPLAYCONTROL | _displayctrl);
 }
 
+void lcddisplayon()
+{displaycontrol(_displayctrl | LCD1602_DISPLAYON);}
+
+void lcddisplayoff()
+{displaycontrol(_displayctrl & ~LCD1602_DISPLAYON);}
+
 void lcdcursoron()
-{
-    _displayctrl |= LCD1602_CURSORON;
-    command(LCD1602_DISPLAYCONTROL | _displayctrl);
-}
+{displaycontrol(_displayctrl | LCD1602_CURSORON);}
 
 void lcdcursoroff()
-{
-    _displayctrl &= ~LCD1602_CURSORON;
-    command(LCD1602_DISPLAYCONTROL | _displayctrl);
-}
+{displaycontrol(_displayctrl & ~LCD1602_CURSORON);}
 
 void lcdbacklighton()
 {
-    _backlight = LCD1602_BACKLIGHT;
-    expanderwrite(0);
+    lcdxbacklight = LCD1602_BACKLIGHT;
+    if (lcdpresent())
+        lcdxidle();
 }
 
 void lcdbacklightoff()
 {
-    _backlight = LCD1602_NOBACKLIGHT;
-    expanderwrite(0);
+    lcdxbacklight = LCD1602_NOBACKLIGHT;
+    if (lcdpresent())
+        lcdxidle();
 }
 
+// Returns once every queued byte was sent (I2C_QUEUE), immediately otherwise.
+void lcdflush()
+{lcdxflush();}
+
 void lcdwrite(unsigned char value)
-{data(value);}
+{
+    if (!lcdpresent())
+        return;
+    lcdxdata(value);
+    acnext();
+}
 
+// The whole string goes out in a single I2C transaction.
 void lcdwritestring(unsigned char str[])
 {
     unsigned int i = 0;
 
+    if (!lcdpresent())
+        return;
+    lcdxbegin(LCD_XRS);
     while (str[i] != '\0')
     {
-        data(str[i]);
+        lcdxwrite(str[i], LCD_XRS);
+        acnext();
         i++;
     }
+    lcdxend();
+}
+
+// Loads the 8 rows of a custom character into CGRAM slot 'location' (0 to 7),
+// address and pattern bytes in a single I2C transaction.
+// The address counter is left in CGRAM: call lcdsetcursor() before writing text again.
+void lcdcreatechar(unsigned char location, unsigned char charmap[])
+{
+    unsigned char i;
+
+    if (!lcdpresent())
+        return;
+    lcdxbegin(0);
+    lcdxwrite(LCD1602_SETCGRAMADDR | ((location & 0x07) << 3), 0);
+    for (i = 0; i < 8; i++)
+        lcdxwrite(charmap[i], LCD_XRS);
+    lcdxend();
+    _ac = 0;
 }
+
+#ifdef LCD_READ_ENABLED
+// Reads n characters from DDRAM starting at addr, e.g. a whole line, in a single I2C transaction
+// (repeated starts between the nibble reads), using the address counter auto increment.
+// The address counter is left at addr + n.
+void lcdreadddram(unsigned char addr, unsigned char buf[], unsigned char n)
+{
+    if (!lcdpresent())
+        return;
+    lcdxcommand(LCD1602_SETDDRAMADDR | addr);
+    _ac = LCD1602_SETDDRAMADDR | addr;
+    lcdxread(buf, n);
+    while (n--)
+        acnext();
+}
+#endif
@@ -26,7 +26,8 @@ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
     Fixed functions lcdbacklighton() and lcdbacklightoff(), they were reversed.
 */
 
-// TODO: rename this file (and all references) to hd44780_i2c_pcf8574a.h.
+// Declares the I2C_QUEUE interrupt service routine, which must be visible in the file containing main().
+#include "i2cqueue.h"
 
 // commands
 #define LCD1602_CLEARDISPLAY    0x01
@@ -65,8 +66,9 @@ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 // flags for function set
 #define LCD1602_4BITMODE        0x00
 ////////////////////////////////////////////
-// Do *NOT* set the 8bitmode: the i2c module
-// does *NOT* support it.
+// Do *NOT* set the 8bitmode: the PCF8574 and
+// MCP23008 modules do *NOT* support it.
+// The MCP23017 module always uses it.
 #define LCD1602_8BITMODE        0x10
 ////////////////////////////////////////////
 
@@ -76,21 +78,100 @@ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 #define LCD1602_5x8DOTS         0x00
 #define LCD1602_5x10DOTS        0x04
 
-// flags for backlight control
+// Backpack descriptor: the expander pin (bit mask) wired to each LCD line, selected in config.h.
+// The expander bytes are generated at compile time from these masks, for any wiring.
+//  LCD_BACKPACK_PCF8574    common PCF8574/PCF8574A backpack (default)
+//  LCD_BACKPACK_MJKDZ      mjkdz PCF8574 backpack, backlight active low
+//  LCD_BACKPACK_MCP23008   Adafruit I2C/SPI backpack (MCP23008), RW tied to ground
+//  LCD_BACKPACK_MCP23017   MCP23017, 8 bit mode: control on port A, D0..D7 on port B
+//                          (transport in hd44780_i2cbus_mcp23017.c)
+//  LCD_BACKPACK_CUSTOM     masks defined in config.h: Rs, Rw (0 if not wired), En, D4..D7,
+//                          LCD1602_BACKLIGHT and LCD1602_NOBACKLIGHT (pin levels), and
+//                          LCD_BACKPACK_NO_RW if RW is not wired.
+#if defined(LCD_BACKPACK_MCP23008)
+#define Rs                      0x02 // GP1
+#define Rw                      0x00 // Not wired
+#define En                      0x04 // GP2
+#define D4                      0x08 // GP3..GP6
+#define D5                      0x10
+#define D6                      0x20
+#define D7                      0x40
+#define LCD1602_NOBACKLIGHT     0x00
+#define LCD1602_BACKLIGHT       0x80 // GP7
+#define LCD_BACKPACK_NO_RW
+
+#include "mcp23008.h"
+#elif defined(LCD_BACKPACK_MCP23017)
+#define Rs                      0x01 // GPA0
+#define Rw                      0x02 // GPA1
+#define En                      0x04 // GPA2
+#define D4                      0x10 // GPB4..GPB7 (D0..D3 on GPB0..GPB3)
+#define D5                      0x20
+#define D6                      0x40
+#define D7                      0x80
+#define LCD1602_NOBACKLIGHT     0x00
+#define LCD1602_BACKLIGHT       0x08 // GPA3
+
+// MCP23017 registers, IOCON.BANK = 0
+#define MCP23017_IODIRA         0x00
+#define MCP23017_IODIRB         0x01
+#define MCP23017_IOCON          0x0A
+#define MCP23017_GPIOB          0x13
+#define MCP23017_OLATA          0x14
+#define MCP23017_SEQOP          0x20 // IOCON: the address pointer toggles between the A/B pair
+#elif defined(LCD_BACKPACK_MJKDZ)
+#define Rs                      0x40 // P6
+#define Rw                      0x20 // P5
+#define En                      0x10 // P4
+#define D4                      0x01 // P0..P3
+#define D5                      0x02
+#define D6                      0x04
+#define D7                      0x08
+#define LCD1602_NOBACKLIGHT     0x80 // P7, active low
+#define LCD1602_BACKLIGHT       0x00
+#elif !defined(LCD_BACKPACK_CUSTOM)
+#define LCD_BACKPACK_PCF8574
+#define Rs                      0x01 // Register select bit, P0
+#define Rw                      0x02 // Read/Write bit, P1
+#define En                      0x04 // Enable bit, P2
+#define D4                      0x10 // Data bits: LCD D4..D7 (4 bit mode), P4..P7
+#define D5                      0x20
+#define D6                      0x40
+#define D7                      0x80
+// flags for backlight control, P3
 #define LCD1602_NOBACKLIGHT     0x00
 #define LCD1602_BACKLIGHT       0x08
+#endif
 
-#define Rs                      0x01 // Register select bit
-#define Rw                      0x02 // Read/Write bit
-#define En                      0x04 // Enable bit
+// Several displays on the bus: LCD_DISPLAYS and their addresses, LCD_ADDRS, are set in config.h.
+// lcdselect() picks the display the other functions work on (display 0 after reset).
+#ifndef LCD_DISPLAYS
+#define LCD_DISPLAYS            1
+#endif
+#if LCD_DISPLAYS > 1 && !defined(LCD_ADDRS)
+#error "LCD_DISPLAYS > 1: set the I2C addresses in LCD_ADDRS, e.g. {0x27, 0x26}."
+#endif
 
 ///////////////////////////////////////////////////////////////
-// Uncomment to use delays instead of Busy Flag check mechanism
+// Comment out to use delays instead of Busy Flag check mechanism
+// (RW must be wired to the expander, as on the PCF8574 backpacks).
+#ifndef LCD_BACKPACK_NO_RW
 #define LCD_READ_ENABLED
+#endif
 ///////////////////////////////////////////////////////////////
 
 #ifdef LCD_READ_ENABLED
-#define BF                      0x01
+#define BF                      D7 // Busy flag, read on D7 with the high nibble
+#endif
+
+///////////////////////////////////////////////////////////////
+// Comment out to send 3 expander bytes per nibble (setup, E high, E low)
+// instead of 2 (E high together with the nibble, E low).
+#define LCD_TWOBYTE_NIBBLE
+///////////////////////////////////////////////////////////////
+#ifdef LCD_BACKPACK_MCP23017
+// E and the data are on their own ports, written in a single transaction
+#undef LCD_TWOBYTE_NIBBLE
 #endif
 
 // Example: 4bit mode, 40 pixel character, 2 lines, backlight on, no cursor, no blinking, western left-to-right, automatic increment of the character positioning.
@@ -99,12 +180,61 @@ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 // displaymode  = LCD1602_ENTRYLEFT | LCD1602_ENTRYSHIFTDEC;
 // backlight    = LCD1602_BACKLIGHT
 extern void lcdinit(unsigned char displayfn, unsigned char displayctrl, unsigned char displaymode, unsigned char backlight);
+#if LCD_DISPLAYS > 1
+extern void lcdinitall(unsigned char displayfn, unsigned char displayctrl, unsigned char displaymode, unsigned char backlight);
+extern void lcdselect(unsigned char display);
+#endif
+// Non-blocking lcdinit() for the selected display, see hd44780_i2cbus.c: pass a millisecond count,
+// then call lcdinitstep() until it returns 1, before any other function on this display. Each
+// display keeps its own step: lcdinitstep() advances the selected one.
+extern void lcdinitbegin(unsigned char displayfn, unsigned char displayctrl, unsigned char displaymode, unsigned char backlight, unsigned int now_ms);
+extern unsigned char lcdinitstep(unsigned int now_ms);
+// lcdpresent(): 0 while the backpack of the selected display does not answer (the other functions
+// then do nothing), 1 when it does, 2 when it answers again and was just resynchronized: redraw
+// the screen. The other functions call it too, so lcdresynced() returns 1 once after any resync.
+extern unsigned char lcdpresent();
+extern unsigned char lcdresynced();
 extern void lcdclear();
 extern void lcdhome();
 extern void lcdsetcursor(unsigned char col, unsigned char row);
+extern unsigned char lcdgetcursor(unsigned char *col, unsigned char *row);  // 0 if unknown, no bus traffic
 extern void lcddisplayon();
 extern void lcddisplayoff();
 extern void lcdcursoron();
 extern void lcdcursoroff();
 extern void lcdwrite(unsigned char c);
 extern void lcdwritestring(unsigned char str[]);
+extern void lcdcreatechar(unsigned char location, unsigned char charmap[]);
+extern void lcdflush();
+#ifdef LCD_READ_ENABLED
+extern void lcdreadddram(unsigned char addr, unsigned char buf[], unsigned char n);
+#endif
+
+// Transport: the expander side of the driver, used by the HD44780 logic of hd44780_i2cbus.c. It is
+// implemented in hd44780_i2cbus.c for the 4 bit backpacks (PCF8574, MCP23008), and in
+// hd44780_i2cbus_mcp23017.c for the MCP23017 in 8 bit mode. LCD_XBITMODE is its bus width, and
+// LCD_XRS its 'rs' argument for the data register (0 for the instruction register).
+#ifdef LCD_BACKPACK_MCP23017
+#define LCD_XBITMODE            LCD1602_8BITMODE
+#define LCD_XRS                 Rs
+#else
+#define LCD_XBITMODE            LCD1602_4BITMODE
+#define LCD_XRS                 0x10    // Index bit of the nibble tables
+#endif
+extern unsigned char lcdxbacklight;             // Backlight pin level, sent with every expander byte
+extern unsigned char lcdxabsent;                // Set when the expander did not acknowledge a byte
+extern void lcdxsetup();                        // Expander registers, before any LCD traffic
+extern void lcdxidle();                         // Outputs with E low and the backlight level
+extern void lcdxnibble(unsigned char nibble);   // Function set nibble of the reset sequence: 0x03, or 0x02
+                                                // for 4 bit mode, which the 8 bit transport skips
+extern void lcdxcommand(unsigned char value);   // One byte in its own transaction
+extern void lcdxdata(unsigned char value);
+extern void lcdxbegin(unsigned char rs);        // Opens a transaction for lcdxwrite(), closed by lcdxend()
+extern void lcdxwrite(unsigned char value, unsigned char rs);
+extern void lcdxend();
+extern void lcdxflush();                        // Returns once every queued byte was sent
+extern unsigned char lcdxmissing();             // lcdxabsent, or a NAK seen by the I2C_QUEUE transmitter
+#ifdef LCD_READ_ENABLED
+extern void lcdwaitforbusyflag();
+extern void lcdxread(unsigned char buf[], unsigned char n);     // n data bytes from the address counter on
+#endif
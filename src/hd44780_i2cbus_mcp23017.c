@@ -0,0 +1,212 @@
+/*
+    HD44780 over an MCP23017 16 bit I2C expander, in 8 bit mode: the lcdx*() transport of
+    hd44780_i2cbus.c, whose HD44780 logic and API are shared with the other backpacks. Selected
+    with LCD_BACKPACK_MCP23017 in config.h (see hd44780_i2cbus.h for the wiring).
+
+    IOCON.SEQOP is set with IOCON.BANK = 0, so within a transaction the address pointer toggles
+    between the A/B register pair: after the OLATA register byte the data bytes go to OLATA, OLATB,
+    OLATA, OLATB... A transaction starts by setting up RS on port A, then each character is:
+
+    OLATB   D0..D7
+    OLATA   RS|BL|E     E high for one byte (>= 230 ns)
+    OLATB   D0..D7      repeated: the pointer toggles, and the data must stay until E falls
+    OLATA   RS|BL       E low, the character is latched
+
+    4 bytes per character and no nibble ordering, against 6 for the 3 byte per nibble transfer of
+    the PCF8574. The next E rise comes 2 bytes (>= 45 us at 400 kHz) after the last E fall, more
+    than the 37 us execution time.
+*/
+#include <8051.h>
+#include "delay.h"
+#include "hd44780_i2cbus.h"
+#include "i2c.h"
+#include "i2cqueue.h"
+#include "i2csched.h"
+
+#ifdef LCD_BACKPACK_MCP23017
+
+#if LCD_DISPLAYS > 1
+#error "LCD_DISPLAYS > 1 is not supported with LCD_BACKPACK_MCP23017."
+#endif
+
+#ifdef I2C_QUEUE
+// The queue closes a transaction whenever it drains, which would lose the A/B pointer alignment.
+#error "I2C_QUEUE is not supported with LCD_BACKPACK_MCP23017."
+#endif
+
+static unsigned char _rs;           // RS level on port A in the open transaction, 0 or Rs
+
+// Sets lcdxabsent when the expander does not acknowledge, see lcdpresent().
+static void mcp23017put(unsigned char value)
+{
+    if (!lcdxabsent && i2csend(value))
+        lcdxabsent = 1;
+}
+
+static void mcp23017start()
+{
+    i2cstart();
+    if (i2csendaddr())
+        lcdxabsent = 1;
+}
+
+// Single register write, in its own transaction.
+static void mcp23017write(unsigned char reg, unsigned char value)
+{
+    mcp23017start();
+    mcp23017put(reg);
+    mcp23017put(value);
+    i2cstop();
+}
+
+// Opens a transaction on OLATA with RS set up and E low: the next byte goes to OLATB.
+void lcdxbegin(unsigned char rs)
+{
+    _rs = rs;
+    mcp23017start();
+    mcp23017put(MCP23017_OLATA);
+    mcp23017put(rs | lcdxbacklight);
+}
+
+void lcdxend()
+{i2cstop();}
+
+// rs is either 0 (instruction register) or Rs (data register).
+void lcdxwrite(unsigned char value, unsigned char rs)
+{
+    if (rs != _rs) {
+        // RS setup before E rises (tAS >= 40 ns): one more B/A pair.
+        _rs = rs;
+        mcp23017put(value);
+        mcp23017put(rs | lcdxbacklight);
+    }
+    mcp23017put(value);
+    mcp23017put(rs | En | lcdxbacklight);
+    mcp23017put(value);
+    mcp23017put(rs | lcdxbacklight);
+#ifdef I2C_SCHED
+    // Character boundary: the other slaves above LCD_I2C_PRIORITY may use the bus. The new
+    // transaction starts again on OLATA, so the A/B alignment is kept.
+    if (i2cxtop > LCD_I2C_PRIORITY) {
+        i2cstop();
+        i2cxrun(LCD_I2C_PRIORITY);
+        lcdxbegin(_rs);
+    }
+#endif
+}
+
+void lcdxcommand(unsigned char value)
+{
+    lcdxbegin(0);
+    lcdxwrite(value, 0);
+    i2cstop();
+}
+
+void lcdxdata(unsigned char value)
+{
+    lcdxbegin(Rs);
+    lcdxwrite(value, Rs);
+    i2cstop();
+}
+
+// Already in 8 bit mode: the 0x03 nibbles are whole function sets, and 0x02 is skipped.
+void lcdxnibble(unsigned char nibble)
+{
+    if (nibble == 0x03)
+        lcdxcommand(0x30);
+}
+
+void lcdxidle()
+{mcp23017write(MCP23017_OLATA, lcdxbacklight);}
+
+// Expander setup: all pins outputs, A/B pointer toggle.
+void lcdxsetup()
+{
+    mcp23017write(MCP23017_IOCON, MCP23017_SEQOP);
+    // IODIRA, then IODIRB: all pins outputs.
+    mcp23017start();
+    mcp23017put(MCP23017_IODIRA);
+    mcp23017put(0x00);
+    mcp23017put(0x00);
+    i2cstop();
+}
+
+// Nothing is queued by this transport.
+void lcdxflush()
+{}
+
+unsigned char lcdxmissing()
+{return lcdxabsent;}
+
+#ifdef LCD_READ_ENABLED
+// Bounds the wait when the expander does not answer: an absent MCP23017 reads as 0xFF, i.e. busy.
+#define LCD_BF_MAXPOLLS         255
+
+// Raises E with RW high, reads D0..D7 from GPIOB and drops E, with repeated starts.
+// Runs inside an open transaction, with port B set as input.
+static unsigned char readbyte(unsigned char rs)
+{
+    unsigned char value;
+
+    i2csend(MCP23017_OLATA);
+    i2csend(rs | Rw | En | lcdxbacklight);
+    i2crestart();
+    i2csendaddr();
+    i2csend(MCP23017_GPIOB);
+    i2crestart();
+    if (i2csendreadaddr())
+        lcdxabsent = 1;
+    value = i2cread();
+    i2cnak();
+    i2crestart();
+    i2csendaddr();
+    i2csend(MCP23017_OLATA);
+    i2csend(rs | Rw | lcdxbacklight);
+    i2crestart();
+    i2csendaddr();
+    return value;
+}
+
+// Port B is an input only while RW is high, so it never fights the LCD data outputs.
+// RS and RW are set up before the first E rise (tAS >= 40 ns).
+static void readbegin(unsigned char rs)
+{
+    mcp23017write(MCP23017_IODIRB, 0xFF);
+    mcp23017start();
+    mcp23017put(MCP23017_OLATA);
+    mcp23017put(rs | Rw | lcdxbacklight);
+    i2crestart();
+    i2csendaddr();
+}
+
+static void readend()
+{
+    i2cstop();
+    mcp23017write(MCP23017_IODIRB, 0x00);
+}
+
+// Polls the busy flag until it clears.
+void lcdwaitforbusyflag()
+{
+    unsigned char polls = LCD_BF_MAXPOLLS;
+
+    if (lcdxmissing())
+        return;
+    readbegin(0);
+    while ((readbyte(0) & BF) && !lcdxabsent && --polls);
+    readend();
+}
+
+// Reads n characters at the address counter, using its auto increment.
+void lcdxread(unsigned char buf[], unsigned char n)
+{
+    if (lcdxmissing())
+        return;
+    readbegin(Rs);
+    while (!lcdxabsent && n--)
+        *buf++ = readbyte(Rs);
+    readend();
+}
+#endif
+
+#endif
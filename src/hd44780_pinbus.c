@@ -1,43 +1,339 @@
 #include "hd44780_pinbus.h"
 
+// Data lines D4~D7. With IO_D_PORT and IO_D_SHIFT set in the header (D4~D7 on consecutive bits of one port)
+// a nibble is written with one ANL and one ORL on the port latch, which leave the other pins of the port as
+// they are, and read with one MOV; otherwise bit by bit.
+
+#if defined(LCD_BUS_4BIT) && defined(IO_D_PORT)
+#if defined(IO_D4) || defined(IO_D5) || defined(IO_D6) || defined(IO_D7)
+#error "IO_D4~IO_D7 follow from IO_D_PORT and IO_D_SHIFT: define either, not both."
+#endif
+// The pins by name, e.g. P1 and 2 give P1_2: the port and its bits cannot disagree
+#define IO_D_PIN_(port, bit)    port##_##bit
+#define IO_D_PIN(port, bit)     IO_D_PIN_(port, bit)
+#if IO_D_SHIFT == 0
+#define IO_D4               IO_D_PIN(IO_D_PORT, 0)
+#define IO_D5               IO_D_PIN(IO_D_PORT, 1)
+#define IO_D6               IO_D_PIN(IO_D_PORT, 2)
+#define IO_D7               IO_D_PIN(IO_D_PORT, 3)
+#elif IO_D_SHIFT == 1
+#define IO_D4               IO_D_PIN(IO_D_PORT, 1)
+#define IO_D5               IO_D_PIN(IO_D_PORT, 2)
+#define IO_D6               IO_D_PIN(IO_D_PORT, 3)
+#define IO_D7               IO_D_PIN(IO_D_PORT, 4)
+#elif IO_D_SHIFT == 2
+#define IO_D4               IO_D_PIN(IO_D_PORT, 2)
+#define IO_D5               IO_D_PIN(IO_D_PORT, 3)
+#define IO_D6               IO_D_PIN(IO_D_PORT, 4)
+#define IO_D7               IO_D_PIN(IO_D_PORT, 5)
+#elif IO_D_SHIFT == 3
+#define IO_D4               IO_D_PIN(IO_D_PORT, 3)
+#define IO_D5               IO_D_PIN(IO_D_PORT, 4)
+#define IO_D6               IO_D_PIN(IO_D_PORT, 5)
+#define IO_D7               IO_D_PIN(IO_D_PORT, 6)
+#elif IO_D_SHIFT == 4
+#define IO_D4               IO_D_PIN(IO_D_PORT, 4)
+#define IO_D5               IO_D_PIN(IO_D_PORT, 5)
+#define IO_D6               IO_D_PIN(IO_D_PORT, 6)
+#define IO_D7               IO_D_PIN(IO_D_PORT, 7)
+#else
+#error "IO_D_SHIFT is the bit of D4: 0 to 4."
+#endif
+#define IO_D_MASK           (0x0F << IO_D_SHIFT)
+#if IO_D_SHIFT == 4
+#define IO_D_HI(v)          ((v) & 0xF0)                        // High nibble layout: no shift
+#define IO_D_LO(v)          ((v) << 4)                          // SWAP A, ANL A,#0F0H
+#define IO_D_GET_HI()       (IO_D_PORT & 0xF0)
+#define IO_D_GET_LO()       ((IO_D_PORT >> 4) & 0x0F)
+#else
+#define IO_D_HI(v)          (((v) >> 4) << IO_D_SHIFT)          // Low nibble layout: SWAP A, ANL A,#0FH
+#define IO_D_LO(v)          (((v) & 0x0F) << IO_D_SHIFT)
+#define IO_D_GET_HI()       (((IO_D_PORT & IO_D_MASK) >> IO_D_SHIFT) << 4)
+#define IO_D_GET_LO()       ((IO_D_PORT & IO_D_MASK) >> IO_D_SHIFT)
+#endif
+#define IO_D_PUT_HI(v)      do { IO_D_PORT &= ~IO_D_MASK; IO_D_PORT |= IO_D_HI(v) & IO_D_MASK; } while(0)
+#define IO_D_PUT_LO(v)      do { IO_D_PORT &= ~IO_D_MASK; IO_D_PORT |= IO_D_LO(v) & IO_D_MASK; } while(0)
+#define IO_D_RELEASE()      IO_D_PORT |= IO_D_MASK
+#elif defined(LCD_BUS_4BIT) || defined(LCD_BUS_8BIT)
+#define IO_D_PUT_HI(v)      do { IO_D7 = (v)&0x80; IO_D6 = (v)&0x40; IO_D5 = (v)&0x20; IO_D4 = (v)&0x10; } while(0)
+#define IO_D_PUT_LO(v)      do { IO_D7 = (v)&0x08; IO_D6 = (v)&0x04; IO_D5 = (v)&0x02; IO_D4 = (v)&0x01; } while(0)
+#define IO_D_RELEASE()      do { IO_D7 = 1; IO_D6 = 1; IO_D5 = 1; IO_D4 = 1; } while(0)
+#define IO_D_GET_HI()       ((IO_D7?0x80:0x00) | (IO_D6?0x40:0x00) | (IO_D5?0x20:0x00) | (IO_D4?0x10:0x00))
+#define IO_D_GET_LO()       ((IO_D7?0x08:0x00) | (IO_D6?0x04:0x00) | (IO_D5?0x02:0x00) | (IO_D4?0x01:0x00))
+#endif
+
+// Enable lines. With several controllers on the data bus (LCD_CONTROLLERS, M68 mode only) writes strobe every
+// controller selected in lcd_sel, e.g. all of them during the initialization, and reads only the one in lcd_rsel.
+
+#ifndef LCD_CONTROLLERS
+#define LCD_CONTROLLERS 1
+#endif
+
+#if LCD_CONTROLLERS > 1
+#ifndef IO_MODE_M68
+#error "LCD_CONTROLLERS > 1 needs the M68 pin bus, with one E line per controller."
+#endif
+#if LCD_CONTROLLERS > 4
+#error "LCD_CONTROLLERS: 4 enable lines at most."
+#endif
+#define LCD_CTL_ALL         ((1 << LCD_CONTROLLERS) - 1)
+#if LCD_CONTROLLERS > 2
+#define IO_E3_PUT(m, v)     if((m) & 0x04) IO_E3_WR = v
+#else
+#define IO_E3_PUT(m, v)
+#endif
+#if LCD_CONTROLLERS > 3
+#define IO_E4_PUT(m, v)     if((m) & 0x08) IO_E4_WR = v
+#else
+#define IO_E4_PUT(m, v)
+#endif
+#define IO_E_PUT_M(m, v)    do { if((m) & 0x01) IO_E_WR = v; if((m) & 0x02) IO_E2_WR = v; IO_E3_PUT(m, v); IO_E4_PUT(m, v); } while(0)
+#define IO_E_PUT(v)         IO_E_PUT_M(lcd_sel, v)
+#define IO_E_GET(v)         IO_E_PUT_M(lcd_rsel, v)
+#else
+#define IO_E_PUT(v)         IO_E_WR = v
+#define IO_E_GET(v)         IO_E_WR = v
+#endif
+
+#if defined(LCD_40X4) && LCD_CONTROLLERS != 2
+#error "LCD_40X4 needs LCD_CONTROLLERS 2."
+#endif
+
+// A clear or home keeps a controller busy for 1.52 ms: with the busy flag, that wait is left to the next access to
+// the same controller, so the others can be written to meanwhile. LCD_DEFERRED_WAIT does the same after every
+// command and character: the application runs during the 37 us, and only an access coming too early waits.
+#if defined(LCD_DEFERRED_WAIT) && defined(LCD_NO_READ)
+#error "LCD_DEFERRED_WAIT needs the busy flag, undefine LCD_NO_READ."
+#endif
+
+#if (LCD_CONTROLLERS > 1 || defined(LCD_DEFERRED_WAIT)) && !defined(LCD_NO_READ)
+#define LCD_BUSY_MASK
+#if LCD_CONTROLLERS > 1
+#define LCD_SEL             lcd_sel
+#else
+#define LCD_SEL             0x01
+#endif
+#define LCD_WAIT_BUSY()     if(lcd_busy & LCD_SEL) lcd_wait_busy()
+#define LCD_SET_BUSY()      lcd_busy |= LCD_SEL
+static void lcd_wait_busy();
+
+#undef  DELAY_CLR
+#define DELAY_CLR           LCD_SET_BUSY()
+#ifdef LCD_DEFERRED_WAIT
+#undef  DELAY_CMD
+#define DELAY_CMD           LCD_SET_BUSY()
+#endif
+#else
+#define LCD_WAIT_BUSY()
+#endif
+
+// LCD_CALIBRATE times the busy flag of a character and of a clear with Timer0 at the end of disp_start(), and turns
+// them into soft delay parameters for this panel (its oscillator runs at 190~350 kHz), plus a margin. The busy flag
+// is still polled, as it returns as soon as the controller is ready: disp_get_cal() hands the parameters to a build
+// of the same panel with LCD_NO_READ, where LCD_CAL_CMD and LCD_CAL_CLR replace the worst case FN_DELAY_CMD and
+// FN_DELAY_CLR. The wait loops are timed with Timer0 too, so the parameters do not depend on the timer clock
+// (XTAL_FREQ/12, also on most 1T cores) nor on MCU_CYCLE. 0 if a measure overflowed
+#ifdef LCD_CALIBRATE
+#if defined(LCD_NO_READ) || defined(LCD_BUSY_MASK)
+#error "LCD_CALIBRATE needs the busy flag, and cannot be used with LCD_DEFERRED_WAIT or LCD_CONTROLLERS > 1."
+#endif
+#endif
+#if defined(LCD_CALIBRATE) || defined(LCD_CAL_CMD)
+#if INST_CYCLE_NS > 500
+#define CAL_CMD_512         0                   // Loop of the command wait: lcd_wait_2t()
+#define CAL_CMD_N           250                 // and its iterations timed
+#define CAL_WAIT_CMD(t)     lcd_wait_2t(t)
+#else
+#define CAL_CMD_512         1                   // lcd_wait_512t()
+#define CAL_CMD_N           2
+#define CAL_WAIT_CMD(t)     lcd_wait_512t(t)
+#endif
+#define CAL_CLR_N           2
+#endif
+
+// LCD_CALIBRATE_LOOPS times lcd_wait_2t() and lcd_wait_512t() with Timer0 at the start of disp_start(), then sizes
+// the FN_DELAY_* waits from the loop speed measured instead of MCU_CYCLE, each in the shortest loop it fits in.
+// Timer0 counts XTAL_FREQ/LOOP_TIMER_DIV: 12 on the standard core, and by default on the 1T derivatives
+#ifdef LCD_CALIBRATE_LOOPS
+#ifndef LOOP_TIMER_DIV
+#define LOOP_TIMER_DIV      12
+#endif
+#define LOOP_N2             250                 // Iterations timed
+#define LOOP_N512           2
+#define LOOP_512            0x0100              // Loop of a wait parameter, in its high byte: lcd_wait_2t() if 0
+#define LOOP_65K            0x0200
+#define LOOP_TICKS(us)      (((uint32_t)(us)*(XTAL_FREQ/1000) + LOOP_TIMER_DIV*1000 - 1)/(LOOP_TIMER_DIV*1000))
+
+#undef  FN_DELAY_PWRON
+#undef  FN_DELAY_CLR
+#undef  FN_DELAY_CMD
+#undef  FN_DELAY_INIT_PHASE1
+#undef  FN_DELAY_INIT_PHASE2
+#define FN_DELAY_PWRON          lcd_loop_wait(lcd_loop_pwron)
+#define FN_DELAY_CLR            lcd_loop_wait(lcd_loop_clr)
+#define FN_DELAY_CMD            lcd_loop_wait(lcd_loop_cmd)
+#define FN_DELAY_INIT_PHASE1    lcd_loop_wait(lcd_loop_init1)
+#define FN_DELAY_INIT_PHASE2    lcd_loop_wait(lcd_loop_init2)
+#endif
+
+// The parameters measured by LCD_CALIBRATE on this panel, for the waits of an LCD_NO_READ build
+#ifdef LCD_CAL_CMD
+#ifndef LCD_NO_READ
+#error "LCD_CAL_CMD and LCD_CAL_CLR are the waits of an LCD_NO_READ build, the busy flag is faster."
+#endif
+#if !defined(LCD_CAL_CLR) || LCD_CAL_CMD == 0 || LCD_CAL_CLR == 0
+#error "LCD_CAL_CMD and LCD_CAL_CLR go together, and 0 means disp_get_cal() measured nothing."
+#endif
+#undef  FN_DELAY_CMD
+#undef  FN_DELAY_CLR
+#define FN_DELAY_CMD        CAL_WAIT_CMD(LCD_CAL_CMD)
+#define FN_DELAY_CLR        lcd_wait_512t(LCD_CAL_CLR)
+#endif
+
+// LCD_SHADOW keeps the screen in a buffer of LCD_SHADOW_ROWS*LCD_SHADOW_COLS cells, row by row: disp_put_cur(),
+// disp_print(), disp_println(), disp_printf() and disp_clear() only change it, and disp_flush() sends the cells
+// changed since, in DDRAM order. The address is set only before a cell that does not follow the last one
+// written, so a digit that changed costs 2 transfers, and on a 4 line display row 0 runs on into row 2, row 1
+// into row 3 (the address counter of the model follows the display)
+#ifdef LCD_SHADOW
+#if LCD_CONTROLLERS > 1
+#error "LCD_SHADOW supports a single controller."
+#endif
+#ifndef LCD_SHADOW_ROWS
+#define LCD_SHADOW_ROWS     2
+#endif
+#ifndef LCD_SHADOW_COLS
+#define LCD_SHADOW_COLS     16
+#endif
+#define SHADOW_CELLS        (LCD_SHADOW_ROWS * LCD_SHADOW_COLS)
+#if SHADOW_CELLS > 255
+#error "LCD_SHADOW_ROWS * LCD_SHADOW_COLS must be 255 at most."
+#endif
+// The default __idata buffer must leave room for the registers and the stack, see LCD_SHADOW_IRAM in the header
+#ifndef LCD_SHADOW_MEM
+#define LCD_SHADOW_MEM      __idata
+#ifndef LCD_SHADOW_IRAM
+#define LCD_SHADOW_IRAM     48
+#endif
+#if SHADOW_CELLS + (SHADOW_CELLS + 7) / 8 > LCD_SHADOW_IRAM
+#error "LCD_SHADOW: the buffer does not fit in LCD_SHADOW_IRAM bytes of __idata."
+#endif
+#endif
+#define SHADOW_BIT(i)       (1 << ((i) & 7))
+#endif
+
 // Variables
 
 static uint8_t size_row;
 static uint8_t num_row;
+#if LCD_CONTROLLERS > 1
+static uint8_t lcd_sel = LCD_CTL_ALL;       // Controllers written to
+static uint8_t lcd_rsel = 0x01;             // Controller read from, a single one
+#endif
+#ifdef LCD_BUSY_MASK
+static uint8_t lcd_busy;                    // Controllers maybe still executing the last command
+#endif
+#ifdef LCD_40X4
+static uint8_t disp_cur;                    // Cursor and blink bits, shown on the controller selected only
+#endif
+#ifdef LCD_CALIBRATE
+static __data uint8_t lcd_cal_cmd;          // Measured delay parameters, 0 if unknown
+static __data uint8_t lcd_cal_clr;
+#endif
+#ifdef LCD_CALIBRATE_LOOPS
+static __data uint16_t lcd_loop_pwron;      // Tuned wait parameters, see lcd_loop_wait()
+static __data uint16_t lcd_loop_clr;
+static __data uint16_t lcd_loop_cmd;
+static __data uint16_t lcd_loop_init1;
+static __data uint16_t lcd_loop_init2;
+#endif
+#ifdef LCD_SHADOW
+static LCD_SHADOW_MEM uint8_t shadow[SHADOW_CELLS];                 // Characters, row by row
+static LCD_SHADOW_MEM uint8_t shadow_dirty[(SHADOW_CELLS + 7) / 8]; // Cells changed since the last flush
+static uint8_t shadow_cells;                // Rows*columns, at most SHADOW_CELLS
+static uint8_t shadow_pos;                  // Cell of the next character
+static __code uint8_t shadow_rows4[4] = {0, 2, 1, 3};               // Rows of a 4 line display in DDRAM order
+#endif
+// Model of the controllers selected, so that commands that change nothing are dropped and the cursor is known
+// without a read: each holds the last command of its kind, 0 when unknown. The address counter as a set address
+// command: CMD_SET_ADD | DDRAM address, or CMD_SET_ACG | CGRAM address. write_data() and read_data() called
+// directly bypass it: set the address afterwards
+static uint8_t lcd_ac;
+static uint8_t lcd_entry;
+static uint8_t lcd_disp;
+#if LCD_CONTROLLERS > 1
+// The model of each controller, while others are selected
+static uint8_t lcd_ctl_ac[LCD_CONTROLLERS];
+static uint8_t lcd_ctl_entry[LCD_CONTROLLERS];
+static uint8_t lcd_ctl_disp[LCD_CONTROLLERS];
+#endif
 
 // Basic level IO functions
 
+#ifdef LCD_BUS_XDATA
+// The LCD registers in the external data space: each access is a single MOVX, the bus
+// generates the #WR/#RD strobe.
+static volatile __xdata __at(LCD_XDATA_CMD) uint8_t lcd_xcmd;
+static volatile __xdata __at(LCD_XDATA_DATA) uint8_t lcd_xdata;
+
+void write_cmd(uint8_t cmd)
+{
+    LCD_WAIT_BUSY();
+    lcd_xcmd = cmd;
+}
+
+void write_4bit(uint8_t cmd)
+{
+    LCD_WAIT_BUSY();
+    lcd_xcmd = cmd;
+}
+
+void write_data(uint8_t data)
+{
+    LCD_WAIT_BUSY();
+    lcd_xdata = data;
+}
+
+#ifndef LCD_NO_READ
+uint8_t read_bf_addr()
+{
+    return lcd_xcmd;
+}
+
+uint8_t read_data()
+{
+    LCD_WAIT_BUSY();
+    return lcd_xdata;
+}
+#endif
+#endif
+
 # ifdef IO_MODE_M68
 void write_cmd(uint8_t cmd)
 {
-    IO_E_WR = 0;
+    LCD_WAIT_BUSY();
+    IO_E_PUT(0);
 #ifndef LCD_NO_READ
     IO_RW_RD = 0;
 #endif  
     IO_RS = 0;
 
 #ifdef LCD_BUS_4BIT
-    IO_D7 = cmd&0x80;
-    IO_D6 = cmd&0x40;
-    IO_D5 = cmd&0x20;
-    IO_D4 = cmd&0x10;
-    IO_E_WR = 1;
+    IO_D_PUT_HI(cmd);
+    IO_E_PUT(1);
 #ifdef FAST_MCU
     FN_DELAYT_W_EH;
 #endif
-    IO_E_WR = 0;
+    IO_E_PUT(0);
 #ifdef FAST_MCU
     FN_DELAYT_W_END;
 #endif
-    IO_D7 = cmd&0x08;
-    IO_D6 = cmd&0x04;
-    IO_D5 = cmd&0x02;
-    IO_D4 = cmd&0x01;
-    IO_E_WR = 1;
+    IO_D_PUT_LO(cmd);
+    IO_E_PUT(1);
 #ifdef FAST_MCU
     FN_DELAYT_W_EH;
 #endif
-    IO_E_WR = 0;
+    IO_E_PUT(0);
 #ifdef FAST_MCU
     FN_DELAYT_W_END;
 #endif
@@ -52,11 +348,11 @@ void write_cmd(uint8_t cmd)
     IO_D2 = cmd&0x04;
     IO_D1 = cmd&0x02;
     IO_D0 = cmd&0x01;
-    IO_E_WR = 1;
+    IO_E_PUT(1);
 #ifdef FAST_MCU
     FN_DELAYT_W_EH;
 #endif
-    IO_E_WR = 0;
+    IO_E_PUT(0);
 #ifdef FAST_MCU
     FN_DELAYT_W_END;
 #endif
@@ -64,11 +360,11 @@ void write_cmd(uint8_t cmd)
 
 #ifdef LCD_BUS_8P
     IO_D = cmd;
-    IO_E_WR = 1;
+    IO_E_PUT(1);
 #ifdef FAST_MCU
     FN_DELAYT_W_EH;
 #endif
-    IO_E_WR = 0;
+    IO_E_PUT(0);
 #ifdef FAST_MCU
     FN_DELAYT_W_END;
 #endif
@@ -78,7 +374,8 @@ void write_cmd(uint8_t cmd)
 
 void write_4bit(uint8_t cmd)
 {
-    IO_E_WR = 0;
+    LCD_WAIT_BUSY();
+    IO_E_PUT(0);
 #ifndef LCD_NO_READ
     IO_RW_RD = 0;
 #endif
@@ -87,16 +384,13 @@ void write_4bit(uint8_t cmd)
 #ifdef LCD_BUS_8P
     IO_D = cmd;
 #else
-    IO_D7 = cmd&0x80;
-    IO_D6 = cmd&0x40;
-    IO_D5 = cmd&0x20;
-    IO_D4 = cmd&0x10;
+    IO_D_PUT_HI(cmd);
 #endif
-    IO_E_WR = 1;
+    IO_E_PUT(1);
 #ifdef FAST_MCU
     FN_DELAYT_W_EH;
 #endif
-    IO_E_WR = 0;
+    IO_E_PUT(0);
 #ifdef FAST_MCU
     FN_DELAYT_W_END;
 #endif
@@ -104,34 +398,29 @@ void write_4bit(uint8_t cmd)
 
 void write_data(uint8_t data)
 {
-    IO_E_WR = 0;
+    LCD_WAIT_BUSY();
+    IO_E_PUT(0);
 #ifndef LCD_NO_READ
     IO_RW_RD = 0;
 #endif  
     IO_RS = 1;
 
 #ifdef LCD_BUS_4BIT
-    IO_D7 = data&0x80;
-    IO_D6 = data&0x40;
-    IO_D5 = data&0x20;
-    IO_D4 = data&0x10;
-    IO_E_WR = 1;
+    IO_D_PUT_HI(data);
+    IO_E_PUT(1);
 #ifdef FAST_MCU
     FN_DELAYT_W_EH;
 #endif
-    IO_E_WR = 0;
+    IO_E_PUT(0);
 #ifdef FAST_MCU
     FN_DELAYT_W_END;
 #endif
-    IO_D7 = data&0x08;
-    IO_D6 = data&0x04;
-    IO_D5 = data&0x02;
-    IO_D4 = data&0x01;
-    IO_E_WR = 1;
+    IO_D_PUT_LO(data);
+    IO_E_PUT(1);
 #ifdef FAST_MCU
     FN_DELAYT_W_EH;
 #endif
-    IO_E_WR = 0;
+    IO_E_PUT(0);
 #ifdef FAST_MCU
     FN_DELAYT_W_END;
 #endif
@@ -146,11 +435,11 @@ void write_data(uint8_t data)
     IO_D2 = data&0x04;
     IO_D1 = data&0x02;
     IO_D0 = data&0x01;
-    IO_E_WR = 1;
+    IO_E_PUT(1);
 #ifdef FAST_MCU
     FN_DELAYT_W_EH;
 #endif
-    IO_E_WR = 0;
+    IO_E_PUT(0);
 #ifdef FAST_MCU
     FN_DELAYT_W_END;
 #endif
@@ -158,11 +447,11 @@ void write_data(uint8_t data)
 
 #ifdef LCD_BUS_8P
     IO_D = data;
-    IO_E_WR = 1;
+    IO_E_PUT(1);
 #ifdef FAST_MCU
     FN_DELAYT_W_EH;
 #endif
-    IO_E_WR = 0;
+    IO_E_PUT(0);
 #ifdef FAST_MCU
     FN_DELAYT_W_END;
 #endif
@@ -174,6 +463,7 @@ void write_data(uint8_t data)
 #ifdef IO_MODE_I80
 void write_cmd(uint8_t cmd)
 {
+    LCD_WAIT_BUSY();
     IO_E_WR = 1;
 #ifndef LCD_NO_READ
     IO_RW_RD = 1;
@@ -181,10 +471,7 @@ void write_cmd(uint8_t cmd)
     IO_RS = 0;
 
 #ifdef LCD_BUS_4BIT
-    IO_D7 = cmd&0x80;
-    IO_D6 = cmd&0x40;
-    IO_D5 = cmd&0x20;
-    IO_D4 = cmd&0x10;
+    IO_D_PUT_HI(cmd);
     IO_E_WR = 0;
 #ifdef FAST_MCU
     FN_DELAYT_W_EH;
@@ -193,10 +480,7 @@ void write_cmd(uint8_t cmd)
 #ifdef FAST_MCU
     FN_DELAYT_W_END;
 #endif
-    IO_D7 = cmd&0x08;
-    IO_D6 = cmd&0x04;
-    IO_D5 = cmd&0x02;
-    IO_D4 = cmd&0x01;
+    IO_D_PUT_LO(cmd);
     IO_E_WR = 0;
 #ifdef FAST_MCU
     FN_DELAYT_W_EH;
@@ -242,6 +526,7 @@ void write_cmd(uint8_t cmd)
 
 void write_4bit(uint8_t cmd)
 {
+    LCD_WAIT_BUSY();
     IO_E_WR = 1;
 #ifndef LCD_NO_READ
     IO_RW_RD = 1;
@@ -251,10 +536,7 @@ void write_4bit(uint8_t cmd)
 #ifdef LCD_BUS_8P
     IO_D = cmd;
 #else
-    IO_D7 = cmd&0x80;
-    IO_D6 = cmd&0x40;
-    IO_D5 = cmd&0x20;
-    IO_D4 = cmd&0x10;
+    IO_D_PUT_HI(cmd);
 #endif
     IO_E_WR = 0;
 #ifdef FAST_MCU
@@ -268,6 +550,7 @@ void write_4bit(uint8_t cmd)
 
 void write_data(uint8_t data)
 {
+    LCD_WAIT_BUSY();
     IO_E_WR = 1;
 #ifndef LCD_NO_READ
     IO_RW_RD = 1;
@@ -275,10 +558,7 @@ void write_data(uint8_t data)
     IO_RS = 1;
 
 #ifdef LCD_BUS_4BIT
-    IO_D7 = data&0x80;
-    IO_D6 = data&0x40;
-    IO_D5 = data&0x20;
-    IO_D4 = data&0x10;
+    IO_D_PUT_HI(data);
     IO_E_WR = 0;
 #ifdef FAST_MCU
     FN_DELAYT_W_EH;
@@ -287,10 +567,7 @@ void write_data(uint8_t data)
 #ifdef FAST_MCU
     FN_DELAYT_W_END;
 #endif
-    IO_D7 = data&0x08;
-    IO_D6 = data&0x04;
-    IO_D5 = data&0x02;
-    IO_D4 = data&0x01;
+    IO_D_PUT_LO(data);
     IO_E_WR = 0;
 #ifdef FAST_MCU
     FN_DELAYT_W_EH;
@@ -350,10 +627,7 @@ uint8_t read_bf_addr()
 // Initialize
 
 #ifdef LCD_BUS_4BIT
-    IO_D7 = 1;
-    IO_D6 = 1;
-    IO_D5 = 1;
-    IO_D4 = 1;
+    IO_D_RELEASE();
 #endif
 
 #ifdef LCD_BUS_8BIT
@@ -371,7 +645,7 @@ uint8_t read_bf_addr()
     IO_D = 0xFF;
 #endif
 
-    IO_E_WR = 0;
+    IO_E_GET(0);
     IO_RW_RD = 1; 
     IO_RS = 0;
 #ifdef FAST_MCU
@@ -381,35 +655,29 @@ uint8_t read_bf_addr()
 // Begin read
 
 #ifdef LCD_BUS_4BIT
-    IO_E_WR = 1;
+    IO_E_GET(1);
 #ifdef FAST_MCU
     FN_DELAYT_R_E2D;
 #endif
-    addr |= IO_D7?0x80:0x00;
-    addr |= IO_D6?0x40:0x00;
-    addr |= IO_D5?0x20:0x00;
-    addr |= IO_D4?0x10:0x00;
-    IO_E_WR = 0;
+    addr |= IO_D_GET_HI();
+    IO_E_GET(0);
 #ifdef FAST_MCU
     FN_DELAYT_R_END;
 #endif
 
-    IO_E_WR = 1;
+    IO_E_GET(1);
 #ifdef FAST_MCU
     FN_DELAYT_R_E2D;
 #endif
-    addr |= IO_D7?0x08:0x00;
-    addr |= IO_D6?0x04:0x00;
-    addr |= IO_D5?0x02:0x00;
-    addr |= IO_D4?0x01:0x00;
-    IO_E_WR = 0;
+    addr |= IO_D_GET_LO();
+    IO_E_GET(0);
 #ifdef FAST_MCU
     FN_DELAYT_R_END;
 #endif
 #endif
 
 #ifdef LCD_BUS_8BIT
-    IO_E_WR = 1;
+    IO_E_GET(1);
 #ifdef FAST_MCU
     FN_DELAYT_R_E2D;
 #endif
@@ -421,19 +689,19 @@ uint8_t read_bf_addr()
     addr |= IO_D2?0x04:0x00;
     addr |= IO_D1?0x02:0x00;
     addr |= IO_D0?0x01:0x00;
-    IO_E_WR = 0;
+    IO_E_GET(0);
 #ifdef FAST_MCU
     FN_DELAYT_R_END;
 #endif
 #endif
 
 #ifdef LCD_BUS_8P
-    IO_E_WR = 1;
+    IO_E_GET(1);
 #ifdef FAST_MCU
     FN_DELAYT_R_E2D;
 #endif
     addr = IO_D;
-    IO_E_WR = 0;
+    IO_E_GET(0);
 #ifdef FAST_MCU
     FN_DELAYT_R_END;
 #endif
@@ -447,13 +715,12 @@ uint8_t read_data()
 {
     uint8_t data = 0;
 
+    LCD_WAIT_BUSY();
+
 // Initialize
 
 #ifdef LCD_BUS_4BIT
-    IO_D7 = 1;
-    IO_D6 = 1;
-    IO_D5 = 1;
-    IO_D4 = 1;
+    IO_D_RELEASE();
 #endif
 
 #ifdef LCD_BUS_8BIT
@@ -471,7 +738,7 @@ uint8_t read_data()
     IO_D = 0xFF;
 #endif
 
-    IO_E_WR = 0;
+    IO_E_GET(0);
     IO_RW_RD = 1; 
     IO_RS = 1;
 #ifdef FAST_MCU
@@ -481,34 +748,28 @@ uint8_t read_data()
 // Begin read
 
 #ifdef LCD_BUS_4BIT
-    IO_E_WR = 1;
+    IO_E_GET(1);
 #ifdef FAST_MCU
     FN_DELAYT_R_E2D;
 #endif
-    data |= IO_D7?0x80:0x00;
-    data |= IO_D6?0x40:0x00;
-    data |= IO_D5?0x20:0x00;
-    data |= IO_D4?0x10:0x00;
-    IO_E_WR = 0;
+    data |= IO_D_GET_HI();
+    IO_E_GET(0);
 #ifdef FAST_MCU
     FN_DELAYT_R_END;
 #endif
-    IO_E_WR = 1;
+    IO_E_GET(1);
 #ifdef FAST_MCU
     FN_DELAYT_R_E2D;
 #endif
-    data |= IO_D7?0x08:0x00;
-    data |= IO_D6?0x04:0x00;
-    data |= IO_D5?0x02:0x00;
-    data |= IO_D4?0x01:0x00;
-    IO_E_WR = 0;
+    data |= IO_D_GET_LO();
+    IO_E_GET(0);
 #ifdef FAST_MCU
     FN_DELAYT_R_END;
 #endif
 #endif
 
 #ifdef LCD_BUS_8BIT
-    IO_E_WR = 1;
+    IO_E_GET(1);
 #ifdef FAST_MCU
     FN_DELAYT_R_E2D;
 #endif
@@ -520,19 +781,19 @@ uint8_t read_data()
     data |= IO_D2?0x04:0x00;
     data |= IO_D1?0x02:0x00;
     data |= IO_D0?0x01:0x00;
-    IO_E_WR = 0;
+    IO_E_GET(0);
 #ifdef FAST_MCU
     FN_DELAYT_R_END;
 #endif
 #endif
 
 #ifdef LCD_BUS_8P
-    IO_E_WR = 1;
+    IO_E_GET(1);
 #ifdef FAST_MCU
     FN_DELAYT_R_E2D;
 #endif
     data = IO_D;
-    IO_E_WR = 0;
+    IO_E_GET(0);
 #ifdef FAST_MCU
     FN_DELAYT_R_END;
 #endif
@@ -556,10 +817,7 @@ uint8_t read_bf_addr()
     IO_RS = 0;
 
 #ifdef LCD_BUS_4BIT
-    IO_D7 = 1;
-    IO_D6 = 1;
-    IO_D5 = 1;
-    IO_D4 = 1;
+    IO_D_RELEASE();
 #endif
 
 #ifdef LCD_BUS_8BIT
@@ -588,10 +846,7 @@ uint8_t read_bf_addr()
 #ifdef FAST_MCU
     FN_DELAYT_R_E2D;
 #endif
-    addr |= IO_D7?0x80:0x00;
-    addr |= IO_D6?0x40:0x00;
-    addr |= IO_D5?0x20:0x00;
-    addr |= IO_D4?0x10:0x00;
+    addr |= IO_D_GET_HI();
     IO_RW_RD = 1;
 #ifdef FAST_MCU
     FN_DELAYT_R_END;
@@ -601,10 +856,7 @@ uint8_t read_bf_addr()
 #ifdef FAST_MCU
     FN_DELAYT_R_E2D;
 #endif
-    addr |= IO_D7?0x08:0x00;
-    addr |= IO_D6?0x04:0x00;
-    addr |= IO_D5?0x02:0x00;
-    addr |= IO_D4?0x01:0x00;
+    addr |= IO_D_GET_LO();
     IO_RW_RD = 1;
 #ifdef FAST_MCU
     FN_DELAYT_R_END;
@@ -650,16 +902,15 @@ uint8_t read_data()
 {
     uint8_t data = 0;
 
+    LCD_WAIT_BUSY();
+
 // Initialize
     IO_E_WR = 1;
     IO_RW_RD = 1; 
     IO_RS = 1;
 
 #ifdef LCD_BUS_4BIT
-    IO_D7 = 1;
-    IO_D6 = 1;
-    IO_D5 = 1;
-    IO_D4 = 1;
+    IO_D_RELEASE();
 #endif
 
 #ifdef LCD_BUS_8BIT
@@ -688,10 +939,7 @@ uint8_t read_data()
 #ifdef FAST_MCU
     FN_DELAYT_R_E2D;
 #endif
-    data |= IO_D7?0x80:0x00;
-    data |= IO_D6?0x40:0x00;
-    data |= IO_D5?0x20:0x00;
-    data |= IO_D4?0x10:0x00;
+    data |= IO_D_GET_HI();
     IO_RW_RD = 1;
 #ifdef FAST_MCU
     FN_DELAYT_R_END;
@@ -700,10 +948,7 @@ uint8_t read_data()
 #ifdef FAST_MCU
     FN_DELAYT_R_E2D;
 #endif
-    data |= IO_D7?0x08:0x00;
-    data |= IO_D6?0x04:0x00;
-    data |= IO_D5?0x02:0x00;
-    data |= IO_D4?0x01:0x00;
+    data |= IO_D_GET_LO();
     IO_RW_RD = 1;
 #ifdef FAST_MCU
     FN_DELAYT_R_END;
@@ -749,10 +994,39 @@ uint8_t read_data()
 
 void lcd_wait()
 {
+#if LCD_CONTROLLERS > 1
+    // Each selected controller in turn
+    for(lcd_rsel = 0x01; lcd_rsel & LCD_CTL_ALL; lcd_rsel <<= 1) {
+        if(lcd_sel & lcd_rsel)
+            while(read_bf_addr()&0x80);
+    }
+    lcd_rsel = lcd_sel & -lcd_sel;
+#else
     while(read_bf_addr()&0x80);
+#endif
+    return;
+}
+
+#ifdef LCD_BUSY_MASK
+// Wait for the selected controllers left busy by the last command
+static void lcd_wait_busy()
+{
+#if LCD_CONTROLLERS > 1
+    uint8_t sel = lcd_sel;
+
+    lcd_sel &= lcd_busy;
+    lcd_busy &= ~lcd_sel;
+    lcd_wait();
+    lcd_sel = sel;
+    lcd_rsel = sel & -sel;
+#else
+    lcd_busy = 0;
+    lcd_wait();
+#endif
     return;
 }
 #endif
+#endif
 
 // Soft delay functions
 
@@ -772,7 +1046,7 @@ void lcd_wait_512t(uint8_t t)
     return;
 }
 
-#ifdef FAST_MCU
+#if defined(FAST_MCU) || defined(LCD_CALIBRATE_LOOPS)
 void lcd_wait_65kt(uint8_t t)
 {
     uint8_t i;
@@ -788,6 +1062,163 @@ void lcd_wait_65kt(uint8_t t)
 }
 #endif
 
+#ifdef LCD_CALIBRATE_LOOPS
+// Calibrated wait: the parameter of the loop in the low byte, the loop in the high byte
+static void lcd_loop_wait(uint16_t p)
+{
+    if(p & LOOP_65K)
+        lcd_wait_65kt((uint8_t)p);
+    else if(p & LOOP_512)
+        lcd_wait_512t((uint8_t)p);
+    else
+        lcd_wait_2t((uint8_t)p);
+    return;
+}
+
+// Timer0 ticks of a calibrated wait, call included
+static uint16_t lcd_loop_time(uint16_t p)
+{
+    TH0 = 0;
+    TL0 = 0;
+    TR0 = 1;
+    lcd_loop_wait(p);
+    TR0 = 0;
+    return ((uint16_t)TH0 << 8) | TL0;
+}
+
+// Ticks of n iterations of a loop: the same call with a single pass (no iteration) is taken off
+static uint16_t lcd_loop_span(uint16_t loop, uint8_t n)
+{
+    uint16_t t = lcd_loop_time(loop | 1);
+    return lcd_loop_time(loop | (n + 1)) - t;
+}
+
+static __data uint16_t lcd_loop_span2;
+static __data uint16_t lcd_loop_span512;
+
+// Wait parameter for 'ticks' of Timer0, rounded up plus one for the pre-decrement of the loops. An iteration of
+// lcd_wait_65kt() is 254 of lcd_wait_512t(), whose inner loop it repeats
+static uint16_t lcd_loop_param(uint32_t ticks)
+{
+    uint32_t t;
+
+    t = (ticks*LOOP_N2 + lcd_loop_span2 - 1)/lcd_loop_span2 + 1;
+    if(t < 256)
+        return t;
+    t = (ticks*LOOP_N512 + lcd_loop_span512 - 1)/lcd_loop_span512 + 1;
+    if(t < 256)
+        return LOOP_512 | t;
+    t = (ticks*LOOP_N512 + lcd_loop_span512*254UL - 1)/(lcd_loop_span512*254UL) + 1;
+    return LOOP_65K | ((t < 256) ? t : 255);
+}
+
+static void lcd_calibrate_loops()
+{
+    uint8_t tmod = TMOD;
+
+    TMOD = (TMOD & 0xF0) | 0x01;
+    lcd_loop_span2 = lcd_loop_span(0, LOOP_N2);
+    lcd_loop_span512 = lcd_loop_span(LOOP_512, LOOP_N512);
+    TMOD = tmod;
+    // Never 0: a very fast core with a slow timer
+    if(!lcd_loop_span2)
+        lcd_loop_span2 = 1;
+    if(!lcd_loop_span512)
+        lcd_loop_span512 = 1;
+
+    lcd_loop_pwron = lcd_loop_param(LOOP_TICKS(15000));
+    lcd_loop_clr = lcd_loop_param(LOOP_TICKS(1520));
+    lcd_loop_cmd = lcd_loop_param(LOOP_TICKS(37));
+    lcd_loop_init1 = lcd_loop_param(LOOP_TICKS(4100));
+    lcd_loop_init2 = lcd_loop_param(LOOP_TICKS(100));
+    return;
+}
+#endif
+
+// Address counter after a data read or write, or a cursor move: 'inc' as CMD_ENTRY_INC. In 2 line mode DDRAM
+// goes on from 0x27 to 0x40 and from 0x67 to 0x00
+static void lcd_ac_step(uint8_t inc)
+{
+    uint8_t a = lcd_ac & 0x7F;
+
+    if(lcd_ac & CMD_SET_ADD) {
+        if(inc) {
+            if(num_row == 1)
+                a = (a == 0x4F) ? 0x00 : a + 1;
+            else
+                a = (a == 0x27) ? 0x40 : (a == 0x67) ? 0x00 : a + 1;
+        }
+        else {
+            if(num_row == 1)
+                a = (a == 0x00) ? 0x4F : a - 1;
+            else
+                a = (a == 0x40) ? 0x27 : (a == 0x00) ? 0x67 : a - 1;
+        }
+        lcd_ac = CMD_SET_ADD | a;
+    }
+    else if(lcd_ac & CMD_SET_ACG) {
+        lcd_ac = CMD_SET_ACG | ((inc ? a + 1 : a - 1) & 0x3F);
+    }
+    return;
+}
+
+// Data written or read: the address counter follows the entry mode
+static void lcd_ac_next()
+{
+    if(lcd_entry)
+        lcd_ac_step(lcd_entry & CMD_ENTRY_INC);
+    else
+        lcd_ac = 0;
+    return;
+}
+
+// Forget everything, e.g. before the initialization
+static void lcd_model_reset()
+{
+    lcd_ac = 0;
+    lcd_entry = 0;
+    lcd_disp = 0;
+    return;
+}
+
+#if LCD_CONTROLLERS > 1
+// Select other controllers: the model goes back to those left and is loaded from the new ones. When several are
+// selected, what they do not agree on is unknown
+static void lcd_model_select(uint8_t sel)
+{
+    uint8_t i, m;
+    uint8_t ac = 0, entry = 0, disp = 0, first = 1;
+
+    for(i = 0, m = 0x01; i < LCD_CONTROLLERS; i++, m <<= 1) {
+        if(lcd_sel & m) {
+            lcd_ctl_ac[i] = lcd_ac;
+            lcd_ctl_entry[i] = lcd_entry;
+            lcd_ctl_disp[i] = lcd_disp;
+        }
+        if(sel & m) {
+            if(first) {
+                ac = lcd_ctl_ac[i];
+                entry = lcd_ctl_entry[i];
+                disp = lcd_ctl_disp[i];
+                first = 0;
+            } else {
+                if(ac != lcd_ctl_ac[i])
+                    ac = 0;
+                if(entry != lcd_ctl_entry[i])
+                    entry = 0;
+                if(disp != lcd_ctl_disp[i])
+                    disp = 0;
+            }
+        }
+    }
+    lcd_ac = ac;
+    lcd_entry = entry;
+    lcd_disp = disp;
+    lcd_sel = sel;
+    lcd_rsel = sel & -sel;
+    return;
+}
+#endif
 
 // Medium level functions
 
@@ -797,6 +1228,10 @@ void lcd_clear()
 {
     write_cmd(CMD_CLEAR);
     DELAY_CLR;
+    // The clear also sets the increment mode
+    lcd_ac = CMD_SET_ADD;
+    if(lcd_entry)
+        lcd_entry |= CMD_ENTRY_INC;
     return;
 }
 
@@ -804,6 +1239,7 @@ void lcd_home()
 {
     write_cmd(CMD_HOME);
     DELAY_CLR;
+    lcd_ac = CMD_SET_ADD;
     return;
 }
 
@@ -820,15 +1256,23 @@ void lcd_init(uint8_t cmd)
 
 void lcd_set_entry(uint8_t cmd)
 {
-    write_cmd(CMD_ENTRY | (cmd & 0x03));
+    cmd = CMD_ENTRY | (cmd & 0x03);
+    if(cmd == lcd_entry)
+        return;
+    write_cmd(cmd);
     DELAY_CMD;
+    lcd_entry = cmd;
     return;
 }
 
 void lcd_set_disp(uint8_t cmd)
 {
-    write_cmd(CMD_SET_DISP | (cmd & 0x07));
+    cmd = CMD_SET_DISP | (cmd & 0x07);
+    if(cmd == lcd_disp)
+        return;
+    write_cmd(cmd);
     DELAY_CMD;
+    lcd_disp = cmd;
     return;
 }
 
@@ -838,6 +1282,8 @@ void lcd_mov(uint8_t cmd)
 {
     write_cmd(CMD_MOVE | (cmd & 0x0C));
     DELAY_CMD;
+    if(!(cmd & CMD_MOVE_DISP))
+        lcd_ac_step(cmd & CMD_MOVE_RIGHT);
     return;
 }
 
@@ -848,14 +1294,19 @@ void lcd_cpy_ddram(const char *data, uint8_t count)
     for(uint8_t i = 0; i < count; i++) {
         write_data(*(data + i));
         DELAY_CMD;    
+        lcd_ac_next();
     }
     return;
 }
 
 void lcd_put_cur_addr(uint8_t addr)
 {
-    write_cmd(CMD_SET_ADD | addr);
+    addr |= CMD_SET_ADD;
+    if(addr == lcd_ac)
+        return;
+    write_cmd(addr);
     DELAY_CMD;
+    lcd_ac = addr;
     return;
 }
 
@@ -864,20 +1315,26 @@ void lcd_cpy_cgram(const uint8_t *data, uint8_t count)
     for(uint8_t i = 0; i < count; i++) {
         write_data(*(data + i));
         DELAY_CMD;
+        lcd_ac_next();
     }
     return;
 }
 
 void lcd_put_cg_addr(uint8_t addr)
 {
-    write_cmd(CMD_SET_ACG | (addr & 0x3F));
+    addr = CMD_SET_ACG | (addr & 0x3F);
+    if(addr == lcd_ac)
+        return;
+    write_cmd(addr);
     DELAY_CMD;
+    lcd_ac = addr;
     return;
 }
 
 #ifndef LCD_NO_READ
 uint8_t lcd_get_cur_addr()
 {
+    LCD_WAIT_BUSY();
     return (read_bf_addr() & 0x7F);
 }
 
@@ -890,13 +1347,14 @@ void vfd_set_light_cu20045(uint8_t light)
     write_cmd(CMD_INIT | CMD_INIT_4_BIT);
 #endif
 
-#if defined (LCD_BUS_8BIT) || defined (LCD_BUS_8P)
+#if defined (LCD_BUS_8BIT) || defined (LCD_BUS_8P) || defined (LCD_BUS_XDATA)
     write_cmd(CMD_INIT | CMD_INIT_8_BIT);
 #endif
     // Light setting requires data writing command
     DELAY_CMD;
     write_data(light & 0x03);
     DELAY_CMD;
+    lcd_ac = 0;
     return;
 }
 #endif
@@ -913,7 +1371,7 @@ void vfd_set_light_pt6314(uint8_t light)
     }
 #endif
 
-#if defined (LCD_BUS_8BIT) || defined (LCD_BUS_8P)
+#if defined (LCD_BUS_8BIT) || defined (LCD_BUS_8P) || defined (LCD_BUS_XDATA)
     if(size_row == 1) {
         lcd_init(CMD_INIT_8_BIT |  CMD_INIT_8_FONT | CMD_INIT_1_LINE | (light & 0x03));
     }
@@ -927,13 +1385,223 @@ void vfd_set_light_pt6314(uint8_t light)
 }
 #endif
 
+#ifdef LCD_CALIBRATE
+// Timer0 in mode 1 counts from the write to the busy flag clearing, the time of the write and of the last poll
+// included. Returns 0 if it overflowed.
+static void lcd_cal_start()
+{
+    TMOD = (TMOD & 0xF0) | 0x01;
+    TH0 = 0;
+    TL0 = 0;
+    TF0 = 0;
+    TR0 = 1;
+    return;
+}
+
+static uint16_t lcd_cal_stop()
+{
+    while(read_bf_addr()&0x80);
+    TR0 = 0;
+    if(TF0)
+        return 0;
+    return ((uint16_t)TH0 << 8) | TL0;
+}
+
+// Timer0 ticks of lcd_wait_512t(t) if 'w512', else of lcd_wait_2t(t)
+static uint16_t lcd_cal_loop(uint8_t w512, uint8_t t)
+{
+    lcd_cal_start();
+    if(w512)
+        lcd_wait_512t(t);
+    else
+        lcd_wait_2t(t);
+    TR0 = 0;
+    return ((uint16_t)TH0 << 8) | TL0;
+}
+
+// Ticks of n iterations of a wait loop: the same call with no iteration (t = 1) is taken off, with the timer start
+// and stop. Never 0
+static uint16_t lcd_cal_span(uint8_t w512, uint8_t n)
+{
+    uint16_t t = lcd_cal_loop(w512, 1);
+
+    t = lcd_cal_loop(w512, n + 1) - t;
+    return t ? t : 1;
+}
+
+// Delay parameter for 'ticks' with a loop taking 'span' ticks for n iterations: rounded up, 25% margin for the
+// oscillator drift with temperature and supply, plus one for the pre-decrement of the wait loops. 0 if out of
+// range
+static uint8_t lcd_cal_param(uint16_t ticks, uint16_t span, uint8_t n)
+{
+    uint32_t t;
+
+    if(!ticks)
+        return 0;
+    t = ((uint32_t)ticks * n + span - 1) / span;
+    t += (t >> 2) + 1;
+    return (t > 255) ? 0 : t;
+}
+
+static void lcd_calibrate()
+{
+    uint8_t tmod = TMOD;
+    uint16_t ticks;
+
+    // A space at the home position of the cleared display, then the clear again
+    lcd_cal_start();
+    write_data(' ');
+    ticks = lcd_cal_stop();
+    lcd_cal_cmd = lcd_cal_param(ticks, lcd_cal_span(CAL_CMD_512, CAL_CMD_N), CAL_CMD_N);
+
+    lcd_cal_start();
+    write_cmd(CMD_CLEAR);
+    ticks = lcd_cal_stop();
+    lcd_cal_clr = lcd_cal_param(ticks, lcd_cal_span(1, CAL_CLR_N), CAL_CLR_N);
+
+    TMOD = tmod;
+    return;
+}
+
+void disp_get_cal(uint8_t *cmd, uint8_t *clr)
+{
+    *cmd = lcd_cal_cmd;
+    *clr = lcd_cal_clr;
+    return;
+}
+#endif
+
 // High level functions
 
-void disp_start(uint8_t row, uint8_t col)
+#if LCD_CONTROLLERS > 1
+void disp_select(uint8_t ctl)
+{
+    lcd_model_select((ctl == DISP_ALL) ? LCD_CTL_ALL : (1 << ctl));
+    return;
+}
+#endif
+
+#ifdef LCD_40X4
+// Rows 0~1 are on the first controller, rows 2~3 on the second: select one of them (0x01 or 0x02) or both
+// (LCD_CTL_ALL). The cursor follows a single controller
+static void disp_route(uint8_t ctl)
+{
+    if(ctl == lcd_sel)
+        return;
+    if(disp_cur)
+        lcd_set_disp(CMD_SET_DISP_ON);
+    lcd_model_select(ctl);
+    if(disp_cur && ctl != LCD_CTL_ALL)
+        lcd_set_disp(CMD_SET_DISP_ON | disp_cur);
+    return;
+}
+#endif
+
+// DDRAM address of a position, for a single controller
+static uint8_t disp_addr(uint8_t row, uint8_t col)
+{
+    if(num_row == 2) {
+        switch(row) {
+            case 1:
+                return 0x40 + col;
+            default:
+                return 0x00 + col;
+        }
+    }
+    else if(num_row == 4) {
+        switch(row) {
+            case 3:
+                return 0x54 + col;
+            case 2:
+                return 0x14 + col;
+            case 1:
+                return 0x40 + col;
+            default:
+                return 0x00 + col;
+        }
+    }
+    // Default 1 line
+    return 0x00 + col;
+}
+
+#ifdef LCD_SHADOW
+// The display was just cleared: a blank screen, nothing to send
+static void shadow_reset()
+{
+    uint8_t i;
+    uint16_t cells = (uint16_t)num_row * size_row;
+
+    shadow_cells = (cells > SHADOW_CELLS) ? SHADOW_CELLS : cells;
+    for(i = 0; i < SHADOW_CELLS; i++)
+        shadow[i] = ' ';
+    for(i = 0; i < sizeof(shadow_dirty); i++)
+        shadow_dirty[i] = 0;
+    shadow_pos = 0;
+    return;
+}
+
+// A character past the end of a row goes on at the start of the next one
+static void shadow_put(char c)
+{
+    uint8_t i = shadow_pos;
+
+    if(i >= shadow_cells)
+        return;
+    if(shadow[i] != c) {
+        shadow[i] = c;
+        shadow_dirty[i >> 3] |= SHADOW_BIT(i);
+    }
+    if(++shadow_pos >= shadow_cells)
+        shadow_pos = 0;
+    return;
+}
+
+// lcd_put_cur_addr() sends nothing when the address counter is already there. disp_put_cur() only moves
+// shadow_pos, so the cursor shown by disp_cur_on() is put there at the end.
+void disp_flush()
+{
+    uint8_t k, row, col, i;
+
+    for(k = 0; k < num_row; k++) {
+        row = (num_row == 4) ? shadow_rows4[k] : k;
+        i = row * size_row;
+        for(col = 0; col < size_row && i < shadow_cells; col++, i++) {
+            if(!(shadow_dirty[i >> 3] & SHADOW_BIT(i)))
+                continue;
+            shadow_dirty[i >> 3] &= ~SHADOW_BIT(i);
+            lcd_put_cur_addr(disp_addr(row, col));
+            write_data(shadow[i]);
+            DELAY_CMD;
+            lcd_ac_next();
+        }
+    }
+    // A visible cursor goes back to the logical one (also when the display control is not known)
+    if((!lcd_disp || (lcd_disp & (CMD_SET_CUR_ON | CMD_SET_BLINK_ON))) && shadow_pos < shadow_cells)
+        lcd_put_cur_addr(disp_addr(shadow_pos / size_row, shadow_pos % size_row));
+    return;
+}
+#endif
+
+// disp_start() in 3 parts, shared with disp_start_begin()/disp_start_step()
+
+// Idle levels of the bus and display geometry, before the power on wait
+static void disp_start_io(uint8_t row, uint8_t col)
 {
+#ifdef LCD_CALIBRATE_LOOPS
+    lcd_calibrate_loops();
+#endif
+#if LCD_CONTROLLERS > 1
+    // All the controllers are initialized together
+    lcd_sel = LCD_CTL_ALL;
+    lcd_rsel = 0x01;
+#endif
+#ifdef LCD_BUS_SR595
+    write_sr_init();
+#elif !defined(LCD_BUS_XDATA)
     IO_RS = 0;
+#endif
 #ifdef IO_MODE_M68
-    IO_E_WR = 0;
+    IO_E_PUT(0);
 #ifndef LCD_NO_READ
     IO_RW_RD = 0;
 #endif
@@ -948,28 +1616,28 @@ void disp_start(uint8_t row, uint8_t col)
 
     size_row = col;
     num_row = row;
+    lcd_model_reset();
+#ifdef LCD_CALIBRATE
+    lcd_cal_cmd = 0;
+    lcd_cal_clr = 0;
+#endif
+    return;
+}
 
-    FN_DELAY_PWRON;
-
-    // The additional 3 resets
-    write_4bit(0x30);
-    FN_DELAY_INIT_PHASE1;
-    write_4bit(0x30);
-    FN_DELAY_INIT_PHASE2;
-    write_4bit(0x30);
-    DELAY_CMD;
-
+// Function set after the 3 resets, then display off. The clear follows
+static void disp_start_fn()
+{
 #ifdef LCD_BUS_4BIT
     // 4bit BUS mode requires row setting twice 
     write_4bit(0x20);
-    if(row == 1)
+    if(num_row == 1)
     lcd_init(CMD_INIT_4_BIT | CMD_INIT_8_FONT | CMD_INIT_1_LINE);
     else
     lcd_init(CMD_INIT_4_BIT | CMD_INIT_8_FONT | CMD_INIT_2_LINE);
 #endif
 
-#if defined(LCD_BUS_8BIT) || defined(LCD_BUS_8P)
-    if(row == 1)
+#if defined(LCD_BUS_8BIT) || defined(LCD_BUS_8P) || defined(LCD_BUS_XDATA)
+    if(num_row == 1)
     lcd_init(CMD_INIT_8_BIT | CMD_INIT_8_FONT | CMD_INIT_1_LINE);
     else
     lcd_init(CMD_INIT_8_BIT | CMD_INIT_8_FONT | CMD_INIT_2_LINE);
@@ -977,46 +1645,192 @@ void disp_start(uint8_t row, uint8_t col)
 
     // Requires extra settings
     lcd_set_disp(CMD_SET_DISP_OFF | CMD_SET_CUR_OFF | CMD_SET_BLINK_OFF);
-    lcd_clear();
+    return;
+}
+
+// Entry mode and display on, once the clear is over
+static void disp_start_end()
+{
+    // Out of the clear
+    lcd_ac = CMD_SET_ADD;
     lcd_set_entry(CMD_ENTRY_INC | CMD_ENTRY_CURSOR);
 
     // Turn on display
     lcd_set_disp(CMD_SET_DISP_ON | CMD_SET_CUR_OFF | CMD_SET_BLINK_OFF);
+
+#if LCD_CONTROLLERS > 1
+    // Then talk to the first one, the others keep the same model
+    lcd_model_select(0x01);
+#endif
+#ifdef LCD_40X4
+    disp_cur = 0;
+#endif
+#ifdef LCD_CALIBRATE
+    lcd_calibrate();
+#endif
+#ifdef LCD_SHADOW
+    shadow_reset();
+#endif
+    return;
+}
+
+void disp_start(uint8_t row, uint8_t col)
+{
+    disp_start_io(row, col);
+
+    FN_DELAY_PWRON;
+
+    // The additional 3 resets
+    write_4bit(0x30);
+    FN_DELAY_INIT_PHASE1;
+    write_4bit(0x30);
+    FN_DELAY_INIT_PHASE2;
+    write_4bit(0x30);
+    DELAY_CMD;
+
+    disp_start_fn();
+    lcd_clear();
+    disp_start_end();
+    return;
+}
+
+// Non-blocking initialization: the same sequence, one step per call of disp_start_step() once the wait of the
+// previous step is over. now_ms is any free running millisecond count (it may wrap around); a deadline is one ms
+// more than the wait, as the count may tick right after it is read. The steps themselves take under 0.5 ms, except:
+// - with LCD_CALIBRATE_LOOPS, disp_start_begin() first times the delay loops against timer 0, a few ms;
+// - with LCD_CALIBRATE, the last step times a write and a whole clear (> 1.52 ms) and the timer loops, a few ms.
+// The timebase of ../src/timebase.h is not built with this driver: count the ms in the application's own timer.
+
+static uint8_t disp_init_step;              // Next step, 0 when done
+static uint16_t disp_init_deadline;
+
+void disp_start_begin(uint8_t row, uint8_t col, uint16_t now_ms)
+{
+    disp_start_io(row, col);
+    disp_init_step = 1;
+    // Power on: > 15 ms
+    disp_init_deadline = now_ms + 15 + 1;
     return;
 }
 
+uint8_t disp_start_step(uint16_t now_ms)
+{
+    uint8_t wait;
+
+    if(!disp_init_step)
+        return 1;
+    if((int16_t)(now_ms - disp_init_deadline) < 0)
+        return 0;
+
+    switch(disp_init_step++) {
+        case 1:
+            write_4bit(0x30);
+            wait = 5;               // > 4.1 ms
+            break;
+        case 2:
+            write_4bit(0x30);
+            wait = 1;               // > 100 us
+            break;
+        case 3:
+            write_4bit(0x30);
+            DELAY_CMD;
+            disp_start_fn();
+            write_cmd(CMD_CLEAR);
+            wait = 2;               // > 1.52 ms
+            break;
+        default:
+            disp_start_end();
+            disp_init_step = 0;
+            return 1;
+    }
+    disp_init_deadline = now_ms + wait + 1;
+    return 0;
+}
+
+// On a 40x4, clear, home, on/off and shift go to both controllers, the clears running together
+
 void disp_clear()
 {
+#ifdef LCD_40X4
+    disp_route(LCD_CTL_ALL);
+    lcd_clear();
+    disp_route(0x01);
+#elif defined(LCD_SHADOW)
+    // Blanks the shadow screen: the flush rewrites only the cells that were not blank, without the flicker
+    uint8_t i;
+
+    for(i = 0; i < shadow_cells; i++) {
+        if(shadow[i] != ' ') {
+            shadow[i] = ' ';
+            shadow_dirty[i >> 3] |= SHADOW_BIT(i);
+        }
+    }
+    shadow_pos = 0;
+#else
     lcd_clear();
+#endif
     return;
 }
 
 void disp_home()
 {
+#ifdef LCD_40X4
+    disp_route(LCD_CTL_ALL);
+    lcd_home();
+    disp_route(0x01);
+#else
     lcd_home();
+#endif
+#ifdef LCD_SHADOW
+    shadow_pos = 0;
+#endif
     return;
 }
 
 void disp_on()
 {
+#ifdef LCD_40X4
+    uint8_t sel = lcd_sel;
+
+    disp_cur = 0;
+    disp_route(LCD_CTL_ALL);
     lcd_set_disp(CMD_SET_DISP_ON);
+    disp_route(sel);
+#else
+    lcd_set_disp(CMD_SET_DISP_ON);
+#endif
     return;
 }
 
 void disp_off()
 {
+#ifdef LCD_40X4
+    uint8_t sel = lcd_sel;
+
+    disp_cur = 0;
+    disp_route(LCD_CTL_ALL);
+    lcd_set_disp(CMD_SET_DISP_OFF);
+    disp_route(sel);
+#else
     lcd_set_disp(CMD_SET_DISP_OFF);
+#endif
     return;
 }
 
 void disp_cur_on()
 {
+#ifdef LCD_40X4
+    disp_cur = CMD_SET_CUR_ON | CMD_SET_BLINK_ON;
+#endif
     lcd_set_disp(CMD_SET_DISP_ON | CMD_SET_CUR_ON | CMD_SET_BLINK_ON);
     return;
 }
 
 void disp_cur_off()
 {
+#ifdef LCD_40X4
+    disp_cur = 0;
+#endif
     lcd_set_disp(CMD_SET_DISP_ON | CMD_SET_CUR_OFF | CMD_SET_BLINK_OFF);
     return;
 }
@@ -1025,44 +1839,34 @@ void disp_cur_off()
 void disp_put_cur(uint8_t row, uint8_t col)
 {
     // The number of row and column begin at 0
-    uint8_t addr;
-
-    if(num_row == 2) {
-        switch(row) {
-            case 1:
-                addr = 0x40 + col;
-                break;
-            default:
-                addr = 0x00 + col;
-        }
-    }
-    else if(num_row == 4) {
-        switch(row) {
-            case 3:
-                addr = 0x54 + col;
-                break;
-            case 2:
-                addr = 0x14 + col;
-                break;
-            case 1:
-                addr = 0x40 + col;
-                break;
-            default:
-                addr = 0x00 + col;
-        }
-    }
-    // Default 1 line
-    else {
-        addr = 0x00 + col;
-    }
-    lcd_put_cur_addr(addr);
+#ifdef LCD_40X4
+    disp_route((row & 0x02) ? 0x02 : 0x01);
+    lcd_put_cur_addr(((row & 0x01) ? 0x40 : 0x00) + col);
+#elif defined(LCD_SHADOW)
+    shadow_pos = row * size_row + col;
+#else
+    lcd_put_cur_addr(disp_addr(row, col));
+#endif
     return;
 }
 
 #ifndef LCD_NO_READ
 void disp_get_cur(uint8_t *row, uint8_t *col)
 {
-    uint8_t addr = lcd_get_cur_addr();
+#ifdef LCD_SHADOW
+    *row = shadow_pos / size_row;
+    *col = shadow_pos % size_row;
+#else
+    // From the model, read only when unknown
+    uint8_t addr = (lcd_ac & CMD_SET_ADD) ? (lcd_ac & 0x7F) : lcd_get_cur_addr();
+#ifdef LCD_40X4
+    *row = (lcd_rsel == 0x02) ? 2 : 0;
+    if(addr >= 0x40) {
+        *row += 1;
+        addr -= 0x40;
+    }
+    *col = addr;
+#else
     if(num_row == 4) {
         if(addr <= 0x13) {
             *row = 0;
@@ -1095,6 +1899,8 @@ void disp_get_cur(uint8_t *row, uint8_t *col)
         *row = 0;
         *col = addr;
     }
+#endif
+#endif
     return;
 }
 
@@ -1102,17 +1908,32 @@ void disp_get_cur(uint8_t *row, uint8_t *col)
 
 void disp_shift(uint8_t orient)
 {
+#ifdef LCD_40X4
+    uint8_t sel = lcd_sel;
+
+    disp_route(LCD_CTL_ALL);
+#endif
     if(!orient) {
         lcd_mov(CMD_MOVE_DISP | CMD_MOVE_LEFT);
     }
     else {
         lcd_mov(CMD_MOVE_DISP | CMD_MOVE_RIGHT);
     }
+#ifdef LCD_40X4
+    disp_route(sel);
+#endif
     return;
 }
 
 void disp_curmov(uint8_t orient)
 {
+#ifdef LCD_SHADOW
+    if(!orient)
+        shadow_pos = shadow_pos ? shadow_pos - 1 : shadow_cells - 1;
+    else if(++shadow_pos >= shadow_cells)
+        shadow_pos = 0;
+    return;
+#endif
     if(!orient) {
         lcd_mov(CMD_MOVE_CURSOR | CMD_MOVE_LEFT);
     }
@@ -1124,14 +1945,24 @@ void disp_curmov(uint8_t orient)
 
 void disp_print(char c)
 {
+#ifdef LCD_SHADOW
+    shadow_put(c);
+#else
     write_data(c);
     DELAY_CMD;
+    lcd_ac_next();
+#endif
     return;
 }
 
 void disp_println(const char *data, uint8_t count)
 {
+#ifdef LCD_SHADOW
+    while(count--)
+        shadow_put(*data++);
+#else
     lcd_cpy_ddram(data, count);
+#endif
     return;
 }
 
@@ -1140,8 +1971,13 @@ static
 void put_char_to_lcd(char c, void *p) _REENTRANT
 {
     p;
+#ifdef LCD_SHADOW
+    shadow_put(c);
+#else
     write_data(c);
     DELAY_CMD;
+    lcd_ac_next();
+#endif
 }
 
 int disp_printf(const char *format, ...)
@@ -0,0 +1,91 @@
+/*
+    Basic level IO functions of hd44780_pinbus.c over a 74HC595 shift register, selected with
+    LCD_BUS_SR595 in hd44780_pinbus.h: the rest of the disp_* API is shared with the pin bus.
+
+    The UART in mode 0 shifts SBUF out LSB first, so the first bit ends up on Q7: SR_BIT() maps a
+    595 output to its SBUF bit, and _sr_code[] holds the SBUF value of each nibble on D4~D7, with
+    the backlight. A nibble is 2 bytes, E high then E low with the same data (hold time), and each
+    write starts with a byte setting up RS before E rises (tAS). E stays high for a whole byte,
+    well over the 230 ns enable pulse, at any MCU_CYCLE.
+
+    5 bytes per character: about 22 us at 22.1184 MHz in 12T mode, plus the execution delay.
+*/
+#include "hd44780_pinbus.h"
+
+#ifdef LCD_BUS_SR595
+
+#define SR_BIT(q)       (0x80 >> (q))
+#define SR_RS           SR_BIT(SR_Q_RS)
+#define SR_E            SR_BIT(SR_Q_E)
+#ifdef SR_Q_BL
+#define SR_BL           SR_BIT(SR_Q_BL)
+#else
+#define SR_BL           0x00
+#endif
+
+#define SR_NIBBLE(n)    ((((n)&0x01)?SR_BIT(SR_Q_D4):0) | (((n)&0x02)?SR_BIT(SR_Q_D5):0) | \
+                         (((n)&0x04)?SR_BIT(SR_Q_D6):0) | (((n)&0x08)?SR_BIT(SR_Q_D7):0) | SR_BL)
+
+static __code uint8_t _sr_code[16] = {
+    SR_NIBBLE(0x0), SR_NIBBLE(0x1), SR_NIBBLE(0x2), SR_NIBBLE(0x3),
+    SR_NIBBLE(0x4), SR_NIBBLE(0x5), SR_NIBBLE(0x6), SR_NIBBLE(0x7),
+    SR_NIBBLE(0x8), SR_NIBBLE(0x9), SR_NIBBLE(0xA), SR_NIBBLE(0xB),
+    SR_NIBBLE(0xC), SR_NIBBLE(0xD), SR_NIBBLE(0xE), SR_NIBBLE(0xF)
+};
+
+// Shifts one byte and copies it to the 595 outputs. TI is polled rather than used as an
+// interrupt: the next byte cannot be sent before the latch anyway.
+static void sr_put(uint8_t out)
+{
+    SBUF = out;
+    while(!TI);
+    TI = 0;
+    IO_SR_LATCH = 1;
+    IO_SR_LATCH = 0;
+}
+
+static void sr_nibble(uint8_t out)
+{
+    sr_put(out | SR_E);
+    sr_put(out);
+}
+
+void write_sr_init()
+{
+    SCON = 0x00;            // Mode 0, receiver off
+    TI = 0;
+    IO_SR_LATCH = 0;
+    sr_put(SR_BL);
+    return;
+}
+
+void write_cmd(uint8_t cmd)
+{
+    uint8_t out = _sr_code[cmd >> 4];
+
+    sr_put(out);
+    sr_nibble(out);
+    sr_nibble(_sr_code[cmd & 0x0F]);
+    return;
+}
+
+void write_4bit(uint8_t cmd)
+{
+    uint8_t out = _sr_code[cmd >> 4];
+
+    sr_put(out);
+    sr_nibble(out);
+    return;
+}
+
+void write_data(uint8_t data)
+{
+    uint8_t out = _sr_code[data >> 4] | SR_RS;
+
+    sr_put(out);
+    sr_nibble(out);
+    sr_nibble(_sr_code[data & 0x0F] | SR_RS);
+    return;
+}
+
+#endif
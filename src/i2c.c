@@ -19,121 +19,226 @@ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 #include "i2c.h"
 #include "delay.h"
 
+// Instruction cycles already spent in each SCL phase of the C helpers below (start, stop,
+// ack, nak): a single SDA or SCL bit instruction.
+#define I2C_TLOW_OVERHEAD       1
+#define I2C_THIGH_OVERHEAD      1
+
+#define I2C_TLOW_PAD            (I2C_TLOW_CYCLES - I2C_TLOW_OVERHEAD)
+#define I2C_THIGH_PAD           (I2C_THIGH_CYCLES - I2C_THIGH_OVERHEAD)
+
+// When the instructions alone already take longer than the bus timing, the waits vanish.
+#if I2C_TLOW_PAD > 0
+#define i2cdelaylow()           delay_cycles(I2C_TLOW_PAD)
+#else
+#define i2cdelaylow()
+#endif
+
+#if I2C_THIGH_PAD > 0
+#define i2cdelayhigh()          delay_cycles(I2C_THIGH_PAD)
+#else
+#define i2cdelayhigh()
+#endif
+
+// Releases SCL and, with I2C_CLOCK_STRETCH set in config.h, waits for a slave holding it low.
+#ifdef I2C_CLOCK_STRETCH
+#define i2csclhigh()            do { SCL = 1; while (!SCL); } while (0)
+#else
+#define i2csclhigh()            SCL = 1
+#endif
+
 void i2cinit() __naked
 {
     SDA = 1;
-    delay_5us();
-    SCL = 1;
-    delay_5us();
+    i2csclhigh();
+    i2cdelaylow();
     __asm__("ret");
 }
 
 void i2cstart() __naked
 {
     SDA = 0;
-    delay_5us();
+    i2cdelayhigh();
     SCL = 0;
-    delay_5us();
     __asm__("ret");
 }
 
 void i2crestart() __naked
 {
     SDA = 1;
-    delay_5us();
-    SCL = 1;
-    delay_5us();
+    i2cdelaylow();
+    i2csclhigh();
+    i2cdelaylow();
     SDA = 0;
-    delay_5us();
+    i2cdelayhigh();
     SCL = 0;
-    delay_5us();
     __asm__("ret");
 }
 
 void i2cstop() __naked
 {
     SCL = 0;
-    delay_5us();
     SDA = 0;
-    delay_5us();
-    SCL = 1;
-    delay_5us();
+    i2cdelaylow();
+    i2csclhigh();
+    i2cdelayhigh();
     SDA = 1;
-    delay_5us();
+    i2cdelaylow();
     __asm__("ret");
 }
 
 void i2cack() __naked
 {
     SDA = 0;
-    delay_5us();
-    SCL = 1;
-    delay_5us();
+    i2cdelaylow();
+    i2csclhigh();
+    i2cdelayhigh();
     SCL = 0;
-    delay_5us();
     SDA = 1;
-    delay_5us();
     __asm__("ret");
 }
 
 void i2cnak() __naked
 {
     SDA = 1;
-    delay_5us();
-    SCL = 1;
-    delay_5us();
+    i2cdelaylow();
+    i2csclhigh();
+    i2cdelayhigh();
     SCL = 0;
-    delay_5us();
-    SDA = 1;
-    delay_5us();
     __asm__("ret");
 }
 
-unsigned char i2csendaddr()
-{return i2csend(ADDR << 1);}
+// Write address byte of the slave the following transactions go to: ADDR until i2csetaddr().
+__data unsigned char i2cwaddr = ADDR << 1;
 
-unsigned char i2csend(unsigned char data)
-{
-    unsigned char i;
+void i2csetaddr(unsigned char addr)
+{i2cwaddr = addr << 1;}
 
-    for (i = 0; i < 8; i++) {
-        if (data & 0x80)
-            SDA = 1;
-        else
-            SDA = 0;
-
-        delay_5us();
-        SCL = 1;
-        delay_5us();
-        SCL = 0;
-        delay_5us();
-
-        data <<= 1;
-    }
+unsigned char i2csendaddr()
+{return i2csend(i2cwaddr);}
+
+unsigned char i2csendreadaddr()
+{return i2csend(i2cwaddr | 1);}
+
+// Hand scheduled byte shift engine. Every bit is shifted through the carry flag and the 8 bits
+// are unrolled, so each SCL phase costs a fixed number of machine cycles:
+//
+//   rlc  a                     1 cycle     (i2cread: setb c)
+//   mov  SDA,c                 2 cycles    SDA valid (released while reading)
+//   <low pad>                  I2C_ASM_TLOW_PAD cycles
+//   setb SCL                   1 cycle     ---> SCL low:  4 + I2C_ASM_TLOW_PAD cycles
+//   jnb  SCL,.                 2 cycles    (I2C_CLOCK_STRETCH only)
+//   <high pad>                 I2C_ASM_THIGH_PAD cycles
+//   (i2cread: mov c,SDA; rlc a 2 cycles)
+//   clr  SCL                   1 cycle     ---> SCL high: 1 (+2) + I2C_ASM_THIGH_PAD cycles
+//
+// XTAL_FREQ=22118400, MCU_CYCLE=12, I2C_SPEED_HZ=100000: pads of 6 and 9 cycles, 20 cycles per bit.
+#define I2C_ASM_SYM_(x)         _##x
+#define I2C_ASM_SYM(x)          I2C_ASM_SYM_(x)
+#define I2C_SDA_ASM             I2C_ASM_SYM(SDA)
+#define I2C_SCL_ASM             I2C_ASM_SYM(SCL)
+
+#ifdef I2C_CLOCK_STRETCH
+#define I2C_ASM_THIGH_PAD       (I2C_THIGH_CYCLES - 3)
+#define I2C_ASM_SCLHIGH()       __asm setb I2C_SCL_ASM __endasm; __asm jnb I2C_SCL_ASM,. __endasm
+#else
+#define I2C_ASM_THIGH_PAD       (I2C_THIGH_CYCLES - 1)
+#define I2C_ASM_SCLHIGH()       __asm setb I2C_SCL_ASM __endasm
+#endif
+#define I2C_ASM_TLOW_PAD        (I2C_TLOW_CYCLES - 4)
+
+#if I2C_ASM_TLOW_PAD > 512 || I2C_ASM_THIGH_PAD > 512
+#error "I2C_SPEED_HZ is too low for this XTAL_FREQ/MCU_CYCLE: the SCL waits would overflow their loop counter."
+#endif
+
+// Pads of 4 cycles or more are a 'mov r7,direct' (2 cycles) plus 'djnz r7,.' (2 cycles per loop),
+// with a NOP for odd counts; shorter pads are NOPs only. The loop counts are computed by the
+// compiler into these two bytes, the assembler only sees their addresses.
+#if I2C_ASM_TLOW_PAD >= 4
+static __data unsigned char i2clowloops = (I2C_ASM_TLOW_PAD - 2)/2;
+#endif
+#if I2C_ASM_THIGH_PAD >= 4
+static __data unsigned char i2chighloops = (I2C_ASM_THIGH_PAD - 2)/2;
+#endif
+
+#define I2C_ASM_NOP()           __asm nop __endasm
+#define I2C_ASM_PAD(p, loops)                                                           \
+    if ((p) >= 4) { __asm mov r7,loops __endasm; __asm djnz r7,. __endasm; }            \
+    if ((((p) >= 4) ? ((p) - 2) : (((p) > 0) ? (p) : 0)) & 1) { I2C_ASM_NOP(); }        \
+    if (((p) > 1) && ((p) < 4)) { I2C_ASM_NOP(); I2C_ASM_NOP(); }
+
+#define I2C_ASM_PADLOW()        I2C_ASM_PAD(I2C_ASM_TLOW_PAD, _i2clowloops)
+#define I2C_ASM_PADHIGH()       I2C_ASM_PAD(I2C_ASM_THIGH_PAD, _i2chighloops)
+
+// Sends the MSB of A and shifts A left.
+#define I2C_ASM_SENDBIT()                                                               \
+    __asm rlc a __endasm;                                                               \
+    __asm mov I2C_SDA_ASM,c __endasm;                                                   \
+    I2C_ASM_PADLOW();                                                                   \
+    I2C_ASM_SCLHIGH();                                                                  \
+    I2C_ASM_PADHIGH();                                                                  \
+    __asm clr I2C_SCL_ASM __endasm
+
+// Releases SDA, clocks one bit in and samples it into the carry flag.
+#define I2C_ASM_SAMPLEBIT()                                                             \
+    __asm setb c __endasm;                                                              \
+    __asm mov I2C_SDA_ASM,c __endasm;                                                   \
+    I2C_ASM_PADLOW();                                                                   \
+    I2C_ASM_SCLHIGH();                                                                  \
+    I2C_ASM_PADHIGH();                                                                  \
+    __asm mov c,I2C_SDA_ASM __endasm
+
+// Clocks one bit in and shifts it into the LSB of A.
+#define I2C_ASM_READBIT()                                                               \
+    I2C_ASM_SAMPLEBIT();                                                                \
+    __asm rlc a __endasm;                                                               \
+    __asm clr I2C_SCL_ASM __endasm
+
+// Sends 'data' and returns the ACK bit sampled from SDA in the carry flag: 0 = ACK, 1 = NAK.
+// SDA is left released.
+__bit i2csendc(unsigned char data) __naked
+{
+    data;
+    __asm mov a,dpl __endasm;
+    I2C_ASM_SENDBIT();
+    I2C_ASM_SENDBIT();
+    I2C_ASM_SENDBIT();
+    I2C_ASM_SENDBIT();
+    I2C_ASM_SENDBIT();
+    I2C_ASM_SENDBIT();
+    I2C_ASM_SENDBIT();
+    I2C_ASM_SENDBIT();
+    I2C_ASM_SAMPLEBIT();
+    __asm clr I2C_SCL_ASM __endasm;
+    __asm ret __endasm;
+}
 
-    SDA = 1;
-    delay_5us();
-    SCL = 1;
-    i = SDA;
-    delay_5us();
-    SCL = 0;
-    delay_5us();
+unsigned char i2csend(unsigned char data)
+{return i2csendc(data);}
 
-    return i;
+unsigned char i2cread() __naked
+{
+    I2C_ASM_READBIT();
+    I2C_ASM_READBIT();
+    I2C_ASM_READBIT();
+    I2C_ASM_READBIT();
+    I2C_ASM_READBIT();
+    I2C_ASM_READBIT();
+    I2C_ASM_READBIT();
+    I2C_ASM_READBIT();
+    __asm mov dpl,a __endasm;
+    __asm ret __endasm;
 }
 
-unsigned char i2cread()
+// Sequential read of n bytes: ACK after each byte but the last one, which gets a NAK.
+// The caller sends the start and read address before, and the stop after.
+void i2creadbuf(unsigned char buf[], unsigned char n)
 {
-    unsigned char i;
-    unsigned char data = 0;
-
-    for (i = 0; i < 8; i++) {
-        data <<= 1;
-        data |= SDA;
-        SCL = 1;
-        delay_5us();
-        SCL = 0;
-        delay_5us();
+    while (n--) {
+        *buf++ = i2cread();
+        if (n)
+            i2cack();
+        else
+            i2cnak();
     }
-    return data;
 }
@@ -26,15 +26,69 @@ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 
     Fixed bug in the i2cread() function, adding a final 5us delay at the end
     to make it work correctly.
+
+    The fixed 5us delays after every SCL/SDA edge were replaced by a bit clock
+    computed from I2C_SPEED_HZ, XTAL_FREQ and MCU_CYCLE (see below).
 */
 #include "config.h"
 
+// Bus speed in Hz, set in config.h: 100000 (Standard mode) or up to 400000 (Fast mode).
+#ifndef I2C_SPEED_HZ
+#define I2C_SPEED_HZ            100000
+#endif
+
+#if I2C_SPEED_HZ > 400000
+#error "I2C_SPEED_HZ: bit banging supports Standard (100 kHz) and Fast (400 kHz) modes only."
+#endif
+
+// Minimum SCL low/high times from the I2C specification (UM10204, table 10), in ns.
+// Start/stop setup and hold times and the bus free time are not longer than these in
+// either mode, so the same two waits are used for them.
+#if I2C_SPEED_HZ > 100000
+#define I2C_TLOW_MIN_NS         1300
+#define I2C_THIGH_MIN_NS        600
+#else
+#define I2C_TLOW_MIN_NS         4700
+#define I2C_THIGH_MIN_NS        4000
+#endif
+
+// Actual SCL low/high times: half of the period each, stretched to the minimums above.
+#if (500000000/I2C_SPEED_HZ) > I2C_TLOW_MIN_NS
+#define I2C_TLOW_NS             (500000000/I2C_SPEED_HZ)
+#else
+#define I2C_TLOW_NS             I2C_TLOW_MIN_NS
+#endif
+
+#if (1000000000/I2C_SPEED_HZ - I2C_TLOW_NS) > I2C_THIGH_MIN_NS
+#define I2C_THIGH_NS            (1000000000/I2C_SPEED_HZ - I2C_TLOW_NS)
+#else
+#define I2C_THIGH_NS            I2C_THIGH_MIN_NS
+#endif
+
+// Machine cycles per millisecond, and a ns to machine cycles conversion rounding up.
+// XTAL_FREQ=22118400 and MCU_CYCLE=12: 1843 cycles/ms, SCL low and high are 10 cycles each at 100 kHz.
+#define I2C_MCU_KHZ             (XTAL_FREQ/MCU_CYCLE/1000)
+#define I2C_NS_TO_CYCLES(ns)    (((ns)*I2C_MCU_KHZ + 999999)/1000000)
+
+#define I2C_TLOW_CYCLES         I2C_NS_TO_CYCLES(I2C_TLOW_NS)
+#define I2C_THIGH_CYCLES        I2C_NS_TO_CYCLES(I2C_THIGH_NS)
+
+// Machine cycles of one SCL period. Run i2csend() in a simulator (e.g. s51 from the SDCC
+// package) and compare the cycle counter between two SCL rising edges against this value;
+// it is larger only when the MCU cannot reach I2C_SPEED_HZ.
+#define I2C_BIT_CYCLES          (I2C_TLOW_CYCLES + I2C_THIGH_CYCLES)
+
 extern void i2cinit();
 extern void i2cstart();
 extern void i2crestart();
 extern void i2cstop();
 extern void i2cack();
-extern void i2cnakk();
+extern void i2cnak();
+extern __data unsigned char i2cwaddr;              // Slave address << 1, ADDR until i2csetaddr()
+extern void i2csetaddr(unsigned char addr);
 extern unsigned char i2csendaddr();
+extern unsigned char i2csendreadaddr();
 extern unsigned char i2csend(unsigned char);
+extern __bit i2csendc(unsigned char);
 extern unsigned char i2cread();
+extern void i2creadbuf(unsigned char buf[], unsigned char n);
@@ -0,0 +1,176 @@
+/*
+    Timer interrupt driven I2C transmitter, see i2cqueue.h.
+
+    Each timer tick advances the state machine by one SCL phase:
+
+    state       SCL     action
+    IDLE        high    queue not empty: SDA low (start), load the address byte
+    LOW         low     put the next bit on SDA
+    HIGH        high    after 8 bits go to ACKLOW
+    ACKLOW      low     release SDA
+    ACKHIGH     high    sample the ACK: on a NAK set i2cqnak, empty the queue and go to STOP1;
+                        else load I2C_QUEUE_PREFIX once per transaction if defined,
+                        then the next queued byte or go to STOP1
+    STOP1       low     SDA low
+    STOP2       high
+    STOP3       high    SDA high (stop), stop the timer if the queue is empty
+*/
+#include <8051.h>
+#include "i2cqueue.h"
+#include "i2c.h"
+
+#ifdef I2C_QUEUE
+
+#if I2C_QUEUE_TICK < I2C_TLOW_CYCLES || I2C_QUEUE_TICK < I2C_THIGH_CYCLES
+#error "I2C_QUEUE_TICK is shorter than the SCL low/high time required by I2C_SPEED_HZ."
+#endif
+
+#define I2CQ_IDLE               0
+#define I2CQ_LOW                1
+#define I2CQ_HIGH               2
+#define I2CQ_ACKLOW             3
+#define I2CQ_ACKHIGH            4
+#define I2CQ_STOP1              5
+#define I2CQ_STOP2              6
+#define I2CQ_STOP3              7
+
+#define I2CQ_MASK               (I2C_QUEUE_SIZE - 1)
+
+#if I2C_QUEUE_TIMER == 1
+#define I2CQ_TR                 TR1
+#define I2CQ_TH                 TH1
+#define I2CQ_TL                 TL1
+#define I2CQ_ET                 ET1
+#define I2CQ_TMOD_MASK          0x0F
+#define I2CQ_TMOD_MODE2         0x20
+#else
+#define I2CQ_TR                 TR0
+#define I2CQ_TH                 TH0
+#define I2CQ_TL                 TL0
+#define I2CQ_ET                 ET0
+#define I2CQ_TMOD_MASK          0xF0
+#define I2CQ_TMOD_MODE2         0x02
+#endif
+
+static __data unsigned char _queue[I2C_QUEUE_SIZE];
+static volatile __data unsigned char _head = 0;     // Next byte to send, moved by the ISR
+static volatile __data unsigned char _tail = 0;     // Next free slot, moved by the foreground
+static volatile __data unsigned char _state = I2CQ_IDLE;
+static __data unsigned char _shift;
+static __data unsigned char _bits;
+volatile __bit i2cqnak = 0;
+#ifdef I2C_QUEUE_PREFIX
+static __bit _prefixed;                             // Register byte sent in this transaction
+#endif
+
+void i2cqinit()
+{
+    SDA = 1;
+    SCL = 1;
+    I2CQ_TR = 0;
+    TMOD = (TMOD & I2CQ_TMOD_MASK) | I2CQ_TMOD_MODE2;
+    I2CQ_TH = 256 - I2C_QUEUE_TICK;
+    I2CQ_TL = 256 - I2C_QUEUE_TICK;
+    I2CQ_ET = 1;
+    EA = 1;
+}
+
+unsigned char i2cqput(unsigned char value)
+{
+    unsigned char next = (_tail + 1) & I2CQ_MASK;
+
+    if (next == _head)
+        return 0;
+    _queue[_tail] = value;
+    _tail = next;
+    // The ISR stops the timer once the queue is drained.
+    I2CQ_TR = 1;
+    return 1;
+}
+
+unsigned char i2cqspace()
+{return (_head - _tail - 1) & I2CQ_MASK;}
+
+void i2cqflush()
+{
+    while (_head != _tail || _state != I2CQ_IDLE);
+}
+
+void i2cqisr(void) __interrupt(I2C_QUEUE_VECTOR)
+{
+    switch (_state) {
+        case I2CQ_IDLE:
+            if (_head == _tail) {
+                I2CQ_TR = 0;
+                break;
+            }
+            SDA = 0;
+            _shift = i2cwaddr;
+            _bits = 8;
+#ifdef I2C_QUEUE_PREFIX
+            _prefixed = 0;
+#endif
+            _state = I2CQ_LOW;
+            break;
+        case I2CQ_LOW:
+            SCL = 0;
+            SDA = (_shift & 0x80) ? 1 : 0;
+            _shift <<= 1;
+            _bits--;
+            _state = I2CQ_HIGH;
+            break;
+        case I2CQ_HIGH:
+            SCL = 1;
+            _state = _bits ? I2CQ_LOW : I2CQ_ACKLOW;
+            break;
+        case I2CQ_ACKLOW:
+            SCL = 0;
+            SDA = 1;
+            _state = I2CQ_ACKHIGH;
+            break;
+        case I2CQ_ACKHIGH:
+            SCL = 1;
+            if (SDA) {
+                // Not acknowledged: the slave is gone, drop the queued bytes.
+                i2cqnak = 1;
+                _head = _tail;
+                _state = I2CQ_STOP1;
+                break;
+            }
+#ifdef I2C_QUEUE_PREFIX
+            if (!_prefixed) {
+                _prefixed = 1;
+                _shift = I2C_QUEUE_PREFIX;
+                _bits = 8;
+                _state = I2CQ_LOW;
+                break;
+            }
+#endif
+            if (_head != _tail) {
+                _shift = _queue[_head];
+                _head = (_head + 1) & I2CQ_MASK;
+                _bits = 8;
+                _state = I2CQ_LOW;
+            }
+            else
+                _state = I2CQ_STOP1;
+            break;
+        case I2CQ_STOP1:
+            SCL = 0;
+            SDA = 0;
+            _state = I2CQ_STOP2;
+            break;
+        case I2CQ_STOP2:
+            SCL = 1;
+            _state = I2CQ_STOP3;
+            break;
+        default:
+            SDA = 1;
+            _state = I2CQ_IDLE;
+            if (_head == _tail)
+                I2CQ_TR = 0;
+            break;
+    }
+}
+
+#endif
@@ -0,0 +1,60 @@
+/*
+    Background I2C transmission: bytes for the slave at ADDR are queued in a small IRAM
+    ring buffer and bit banged by a timer interrupt, one SCL phase per timer tick.
+    Consecutive bytes share one transaction; a stop is issued when the queue runs empty.
+
+    Enable it in config.h:
+    #define I2C_QUEUE               // Use the background transmitter
+    #define I2C_QUEUE_SIZE  16      // Ring buffer size in bytes, a power of 2 (holds SIZE-1 bytes)
+    #define I2C_QUEUE_TIMER 0       // Timer 0 or 1, in 8 bit auto reload mode
+    #define I2C_QUEUE_TICK  128     // Machine cycles per SCL phase, at most 256
+    #define I2C_QUEUE_PREFIX 0x0A   // Optional register byte sent after the address of every
+                                    // transaction (MCP23008_OLAT with LCD_BACKPACK_MCP23008)
+
+    The interrupt service routine below must be visible in the file containing main(),
+    which is the case when that file includes hd44780_i2cbus.h.
+    Do not call the blocking functions of i2c.h while the queue is not empty: use i2cqflush() first.
+    The same goes for i2csetaddr(): the address is read when a transaction starts.
+*/
+#include "config.h"
+
+#ifdef I2C_QUEUE
+
+#ifndef I2C_QUEUE_SIZE
+#define I2C_QUEUE_SIZE          16
+#endif
+
+#ifndef I2C_QUEUE_TIMER
+#define I2C_QUEUE_TIMER         0
+#endif
+
+#ifndef I2C_QUEUE_TICK
+#define I2C_QUEUE_TICK          128
+#endif
+
+#if defined(LCD_BACKPACK_MCP23008) && !defined(I2C_QUEUE_PREFIX)
+#include "mcp23008.h"
+#define I2C_QUEUE_PREFIX        MCP23008_OLAT
+#endif
+#if (I2C_QUEUE_SIZE & (I2C_QUEUE_SIZE - 1)) || I2C_QUEUE_SIZE > 128
+#error "I2C_QUEUE_SIZE must be a power of 2, at most 128."
+#endif
+
+#if I2C_QUEUE_TICK > 256
+#error "I2C_QUEUE_TICK: the 8 bit timer reloads at most every 256 machine cycles."
+#endif
+
+#if I2C_QUEUE_TIMER == 1
+#define I2C_QUEUE_VECTOR        3   // TF1_VECTOR
+#else
+#define I2C_QUEUE_VECTOR        1   // TF0_VECTOR
+#endif
+
+extern void i2cqinit();                         // Sets up the timer and enables its interrupt
+extern unsigned char i2cqput(unsigned char);    // Queues a byte without blocking, returns 0 when the queue is full
+extern unsigned char i2cqspace();               // Number of bytes that can be queued right now
+extern void i2cqflush();                        // Waits until the queue is empty and the stop condition was sent
+extern volatile __bit i2cqnak;                  // Set by the ISR when a byte was not acknowledged, cleared by the caller
+extern void i2cqisr(void) __interrupt(I2C_QUEUE_VECTOR);
+
+#endif
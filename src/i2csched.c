@@ -0,0 +1,80 @@
+/*
+    Shared bus scheduler, see i2csched.h.
+
+    The pending transactions form a list sorted by priority. It is changed with the interrupts
+    disabled, as i2cxsubmit() may run in an interrupt; the transactions themselves run in the
+    foreground, with the blocking functions of i2c.h.
+*/
+#include <8051.h>
+#include "i2csched.h"
+#include "i2c.h"
+
+#ifdef I2C_SCHED
+
+static struct i2cxfer * volatile _head = 0;
+volatile __data unsigned char i2cxtop = 0;
+
+// Reentrant, its locals on the stack: an interrupt may submit while the foreground is in here.
+void i2cxsubmit(struct i2cxfer *xfer) __reentrant
+{
+    struct i2cxfer *p;
+
+    __critical {
+        xfer->status = I2CX_PENDING;
+        if (!_head || xfer->priority > _head->priority) {
+            xfer->next = _head;
+            _head = xfer;
+            i2cxtop = xfer->priority;
+        }
+        else {
+            p = _head;
+            while (p->next && p->next->priority >= xfer->priority)
+                p = p->next;
+            xfer->next = p->next;
+            p->next = xfer;
+        }
+    }
+}
+
+// Write, then read after a repeated start. Stops at the first byte not acknowledged.
+static unsigned char transfer(struct i2cxfer *xfer)
+{
+    unsigned char i;
+    unsigned char status;
+
+    i2csetaddr(xfer->addr);
+    i2cstart();
+    status = i2csendaddr();
+    for (i = 0; !status && i < xfer->wlen; i++)
+        status = i2csend(xfer->wbuf[i]);
+    if (!status && xfer->rlen) {
+        i2crestart();
+        status = i2csendreadaddr();
+        if (!status)
+            i2creadbuf(xfer->rbuf, xfer->rlen);
+    }
+    i2cstop();
+    // i2csend() returns the ACK bit: 0 (I2CX_OK) or 1 (I2CX_NAK).
+    return status;
+}
+
+void i2cxrun(unsigned char priority)
+{
+    struct i2cxfer *xfer;
+    unsigned char waddr = i2cwaddr;
+
+    while (i2cxtop > priority) {
+        __critical {
+            xfer = _head;
+            _head = xfer->next;
+            i2cxtop = _head ? _head->priority : 0;
+        }
+        xfer->status = transfer(xfer);
+        if (xfer->done)
+            xfer->done(xfer);
+    }
+    // Back to the slave of the interrupted transaction.
+    i2cwaddr = waddr;
+}
+
+#endif
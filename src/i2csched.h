@@ -0,0 +1,45 @@
+/*
+    Shared bus scheduler: transactions for the other slaves on the LCD bus (EEPROM, RTC...) are
+    described by an i2cxfer, queued by priority with i2cxsubmit() and run when the bus is free:
+    from i2cxrun(0) in the main loop, or from inside the LCD functions, which yield the bus between
+    two characters (and between two busy flag polls) to any transaction with a priority above
+    LCD_I2C_PRIORITY. A long lcdwritestring() then delays such a transaction by one character at
+    most: 4 expander bytes, under 0.5 ms at 100 kHz.
+    Enable it in config.h:
+    #define I2C_SCHED               // Use the scheduler
+    #define LCD_I2C_PRIORITY 0      // Priorities above this one cut into the LCD writes
+    Priorities go from 1 to 255, higher first; transactions of equal priority run in order.
+    The done() callbacks may run from inside an LCD function, in the middle of its expander
+    transaction: they must not call the lcd*() functions nor the blocking i2c*() ones. Set a flag
+    there, or submit the next transaction with i2cxsubmit(), and do the rest in the main loop.
+*/
+#include "config.h"
+#ifdef I2C_SCHED
+#ifdef I2C_QUEUE
+#error "I2C_SCHED and I2C_QUEUE cannot be used together."
+#endif
+#ifndef LCD_I2C_PRIORITY
+#define LCD_I2C_PRIORITY        0
+#endif
+
+#define I2CX_OK                 0
+#define I2CX_NAK                1   // A byte, or the address, was not acknowledged
+#define I2CX_PENDING            0xFF
+
+struct i2cxfer {
+    struct i2cxfer *next;           // Set by i2cxsubmit()
+    unsigned char addr;             // 7 bit slave address
+    unsigned char priority;         // 1 to 255, higher first
+    unsigned char *wbuf;            // Bytes written first (e.g. the register or memory address)
+    unsigned char wlen;
+    unsigned char *rbuf;            // Then bytes read after a repeated start, if rlen is not 0
+    unsigned char rlen;
+    void (*done)(struct i2cxfer *); // Called once the transaction is over (see above), 0 to poll status
+    volatile unsigned char status;  // I2CX_PENDING until then, I2CX_OK or I2CX_NAK
+};
+
+extern volatile __data unsigned char i2cxtop;   // Highest pending priority, 0 when none
+
+extern void i2cxsubmit(struct i2cxfer *xfer) __reentrant;  // Queues a transaction, can be called from an interrupt
+extern void i2cxrun(unsigned char priority);    // Runs the pending transactions above 'priority'
+#endif
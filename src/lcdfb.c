@@ -0,0 +1,154 @@
+/*
+    Shadow screen, see lcdfb.h.
+
+    The buffer holds the rows one after the other, with a dirty bit per cell. The flush walks
+    the rows in DDRAM order and follows the address counter of the controller, which goes on
+    from 0x27 to 0x40 in 2 line mode: a run breaks only on a clean cell, or every LCD_FB_RUN
+    characters to bound the string buffer. A character 0 (CGRAM slot 0) ends the strings of
+    lcdwritestring(), so it goes out with lcdwrite().
+*/
+#include "lcdfb.h"
+#include "hd44780_i2cbus.h"
+
+#ifdef LCD_SHADOW
+
+#if LCD_DISPLAYS > 1
+#error "LCD_SHADOW supports a single display."
+#endif
+
+#if LCD_SHADOW_ROWS != 1 && LCD_SHADOW_ROWS != 2 && LCD_SHADOW_ROWS != 4
+#error "LCD_SHADOW_ROWS must be 1, 2 or 4."
+#endif
+
+#if LCD_SHADOW_ROWS * LCD_SHADOW_COLS > 255
+#error "LCD_SHADOW_ROWS * LCD_SHADOW_COLS must be 255 at most."
+#endif
+
+#define LCD_FB_CELLS            (LCD_SHADOW_ROWS * LCD_SHADOW_COLS)
+
+#if defined(LCD_SHADOW_IN_IRAM) && LCD_FB_CELLS + (LCD_FB_CELLS + 7)/8 > LCD_SHADOW_IRAM
+#error "LCD_SHADOW: the buffer does not fit in LCD_SHADOW_IRAM bytes of __idata, see lcdfb.h."
+#endif
+#define LCD_FB_RUN              8
+#define LCD_FB_BIT(i)           (1 << ((i) & 7))
+
+static LCD_SHADOW_MEM unsigned char _fb[LCD_FB_CELLS];
+static LCD_SHADOW_MEM unsigned char _dirty[(LCD_FB_CELLS + 7)/8];
+static unsigned char _pos;                  // Cell of the next character
+static unsigned char _run[LCD_FB_RUN + 1];
+static unsigned char _runlen;
+
+// DDRAM address of each row, as in lcdsetcursor(), and the rows in DDRAM order
+static __code unsigned char _rowaddr[4] = {0x00, 0x40, 0x14, 0x54};
+static __code unsigned char _roworder[4] = {0, 2, 1, 3};
+
+void lcdfbinit()
+{
+    unsigned char i;
+
+    for (i = 0; i < LCD_FB_CELLS; i++)
+        _fb[i] = ' ';
+    for (i = 0; i < sizeof(_dirty); i++)
+        _dirty[i] = 0;
+    _pos = 0;
+}
+
+void lcdfbclear()
+{
+    unsigned char i;
+
+    for (i = 0; i < LCD_FB_CELLS; i++)
+        if (_fb[i] != ' ') {
+            _fb[i] = ' ';
+            _dirty[i >> 3] |= LCD_FB_BIT(i);
+        }
+    _pos = 0;
+}
+
+void lcdfbsetcursor(unsigned char col, unsigned char row)
+{
+    _pos = row * LCD_SHADOW_COLS + col;
+}
+
+void lcdfbwrite(unsigned char c)
+{
+    unsigned char i = _pos;
+
+    if (i >= LCD_FB_CELLS)
+        return;
+    if (_fb[i] != c) {
+        _fb[i] = c;
+        _dirty[i >> 3] |= LCD_FB_BIT(i);
+    }
+    if (++_pos >= LCD_FB_CELLS)
+        _pos = 0;
+}
+
+void lcdfbwritestring(unsigned char str[])
+{
+    unsigned char i = 0;
+
+    while (str[i] != '\0')
+        lcdfbwrite(str[i++]);
+}
+
+// Every cell is sent again by the next flush.
+static void markall()
+{
+    unsigned char i;
+
+    for (i = 0; i < sizeof(_dirty); i++)
+        _dirty[i] = 0xFF;
+}
+
+static void sendrun()
+{
+    if (!_runlen)
+        return;
+    _run[_runlen] = '\0';
+    lcdwritestring(_run);
+    _runlen = 0;
+}
+
+void lcdfbflush()
+{
+    unsigned char k, row, col, i, addr;
+    unsigned char ac = 0xFF;                // Address counter of the controller, unknown yet
+
+    // Nothing goes out while the backpack does not answer: the cells stay dirty until it is back.
+    if (!lcdpresent())
+        return;
+    // A resync, here or in another lcd*() call, may have lost the DDRAM content.
+    if (lcdresynced())
+        markall();
+    for (k = 0; k < LCD_SHADOW_ROWS; k++) {
+        row = (LCD_SHADOW_ROWS == 4) ? _roworder[k] : k;
+        i = row * LCD_SHADOW_COLS;
+        for (col = 0; col < LCD_SHADOW_COLS; col++, i++) {
+            if (!(_dirty[i >> 3] & LCD_FB_BIT(i)))
+                continue;
+            _dirty[i >> 3] &= ~LCD_FB_BIT(i);
+            addr = _rowaddr[row] + col;
+            if (addr != ac) {
+                sendrun();
+                lcdsetcursor(col, row);
+            }
+            if (_fb[i] == '\0') {
+                sendrun();
+                lcdwrite('\0');
+            }
+            else {
+                _run[_runlen++] = _fb[i];
+                if (_runlen == LCD_FB_RUN)
+                    sendrun();
+            }
+            ac = (addr == 0x27 && LCD_SHADOW_ROWS > 1) ? 0x40 : addr + 1;
+        }
+    }
+    sendrun();
+    // Lost during the flush: which cells got through is not known.
+    if (!lcdpresent() || lcdresynced())
+        markall();
+}
+
+#endif
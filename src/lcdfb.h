@@ -0,0 +1,48 @@
+/*
+    Shadow screen for the I2C LCD: the text is drawn in a buffer with lcdfbsetcursor(),
+    lcdfbwrite(), lcdfbwritestring() and lcdfbclear(), and lcdfbflush() sends only the cells
+    changed since the last flush, in DDRAM order, as runs in single lcdwritestring() transactions.
+    The cursor is set only before a cell that does not follow the last one written: on a 20x4
+    row 0 runs on into row 2 (0x13 -> 0x14) and row 1 into row 3 (0x53 -> 0x54), so a dashboard
+    where a few digits changed costs a few bytes per frame.
+    Enable it in config.h:
+    #define LCD_SHADOW              // Use the shadow screen
+    #define LCD_SHADOW_ROWS 4       // Display geometry
+    #define LCD_SHADOW_COLS 20
+    #define LCD_SHADOW_MEM  __xdata // Memory space of the buffer, (rows*columns*9)/8 bytes
+    #define LCD_SHADOW_IRAM 48      // Internal RAM bytes the buffer may take (default)
+    Call lcdfbinit() after lcdinit(). lcdflush() is the I2C_QUEUE flush, unrelated.
+
+    While the backpack does not answer, lcdfbflush() sends nothing and keeps the changes; after a
+    resync (see lcdpresent()) the whole screen is sent again. It reads lcdresynced() for that, so
+    the application should leave it to lcdfbflush().
+
+    The buffer defaults to __idata, and the build stops when it needs more than LCD_SHADOW_IRAM
+    bytes: 36 for a 16x2 fit, the 90 of a 20x4 leave too little of the 128 bytes of an AT89S51
+    for the registers and the stack. Put it in __xdata, or on an 8052 raise LCD_SHADOW_IRAM and
+    link with --iram-size 256. An LCD_SHADOW_MEM set in config.h is not checked.
+*/
+#include "config.h"
+
+#ifdef LCD_SHADOW
+#ifndef LCD_SHADOW_ROWS
+#define LCD_SHADOW_ROWS         2
+#endif
+#ifndef LCD_SHADOW_COLS
+#define LCD_SHADOW_COLS         16
+#endif
+#ifndef LCD_SHADOW_MEM
+#define LCD_SHADOW_MEM          __idata
+#define LCD_SHADOW_IN_IRAM
+#endif
+#ifndef LCD_SHADOW_IRAM
+#define LCD_SHADOW_IRAM         48
+#endif
+
+extern void lcdfbinit();                                        // Blank screen, as left by lcdinit()
+extern void lcdfbclear();                                       // Blanks the buffer, cursor home
+extern void lcdfbsetcursor(unsigned char col, unsigned char row);
+extern void lcdfbwrite(unsigned char c);                        // Past the end of a row, goes on the next one
+extern void lcdfbwritestring(unsigned char str[]);
+extern void lcdfbflush();                                       // Sends the cells changed
+#endif
@@ -0,0 +1,8 @@
+/*
+    MCP23008 registers, for the LCD backpack (hd44780_i2cbus.h) and the register byte that
+    i2cqueue.h sends in front of its transactions.
+*/
+#define MCP23008_IODIR          0x00
+#define MCP23008_IOCON          0x05
+#define MCP23008_OLAT           0x0A
+#define MCP23008_SEQOP          0x20 // IOCON: sequential operation disabled
@@ -0,0 +1,190 @@
+/*
+    Millisecond timebase, see timebase.h.
+
+    The timers count XTAL_FREQ/TIMEBASE_TIMER_DIV, 12 on the standard core and by default on the
+    1T derivatives, whatever MCU_CYCLE is.
+
+    Timers 0 and 1 run in mode 1 and are reloaded by the ISR: the reload is added to the count
+    reached since the overflow, so the interrupt latency does not matter, only the time the timer
+    is stopped for while it is added. That sequence is written in assembler: 8 one cycle
+    instructions from CLR TRx to SETB TRx, during which the timer misses 7 counts on the standard
+    core (TB_STOPPED, scaled by MCU_CYCLE/TIMEBASE_TIMER_DIV for the other cores). Timer 2 reloads
+    itself from RCAP2H/RCAP2L.
+
+    XTAL_FREQ/TIMEBASE_TIMER_DIV is rarely a multiple of 1000 (1843.2 counts per ms at 22.1184 MHz):
+    the fraction left over is accumulated and one tick in a few is made a count longer, so the long
+    term rate is exact.
+*/
+#include "timebase.h"
+
+#ifdef TIMEBASE
+
+#if TIMEBASE_TIMER == 2
+#include <8052.h>
+#else
+#include <8051.h>
+#endif
+
+#define TB_COUNTS_PER_S         (XTAL_FREQ/TIMEBASE_TIMER_DIV)
+#define TB_CYCLES               (TB_COUNTS_PER_S/1000)      // Timer counts per ms, rounded down
+#define TB_FRAC                 (TB_COUNTS_PER_S%1000)      // and the thousandths of a count left over
+#define TB_RELOAD               (uint16_t)(65536 - TB_CYCLES)
+#define TB_US_SCALE             (65536000UL/TB_CYCLES)      // Microseconds per count, 16.16 fixed point
+#define TB_STOPPED              ((7*MCU_CYCLE + TIMEBASE_TIMER_DIV/2)/TIMEBASE_TIMER_DIV)
+
+#if TB_CYCLES > 65535
+#error "TIMEBASE: more than 65535 timer counts per ms, raise TIMEBASE_TIMER_DIV."
+#endif
+#if TB_CYCLES < 2
+#error "TIMEBASE: the timer counts less than twice per ms."
+#endif
+
+#if TIMEBASE_TIMER == 2
+#define TB_TR                   TR2
+#define TB_TH                   TH2
+#define TB_TL                   TL2
+#define TB_TF                   TF2
+#define TB_ET                   ET2
+#elif TIMEBASE_TIMER == 1
+#define TB_TR                   TR1
+#define TB_TH                   TH1
+#define TB_TL                   TL1
+#define TB_TF                   TF1
+#define TB_ET                   ET1
+#define TB_TMOD_MASK            0x0F
+#define TB_TMOD_MODE1           0x10
+#define TB_ASM_TR               _TR1            // The same, as assembler symbols
+#define TB_ASM_TH               _TH1
+#define TB_ASM_TL               _TL1
+#else
+#define TB_TR                   TR0
+#define TB_TH                   TH0
+#define TB_TL                   TL0
+#define TB_TF                   TF0
+#define TB_ET                   ET0
+#define TB_TMOD_MASK            0xF0
+#define TB_TMOD_MODE1           0x01
+#define TB_ASM_TR               _TR0
+#define TB_ASM_TH               _TH0
+#define TB_ASM_TL               _TL0
+#endif
+
+static volatile __data uint16_t _ms = 0;
+#if TB_FRAC
+static __data uint16_t _frac = 0;
+#endif
+#if TIMEBASE_TIMER != 2
+static __data uint16_t _reload;             // Added to the timer by the assembler sequence of tbisr()
+#endif
+__bit tbrunning = 0;
+
+void tbinit()
+{
+    TB_TR = 0;
+#if TIMEBASE_TIMER == 2
+    T2CON = 0x00;                           // Timer, 16 bit auto reload
+    RCAP2H = TB_RELOAD >> 8;
+    RCAP2L = TB_RELOAD & 0xFF;
+#else
+    TMOD = (TMOD & TB_TMOD_MASK) | TB_TMOD_MODE1;
+#endif
+    TB_TH = TB_RELOAD >> 8;
+    TB_TL = TB_RELOAD & 0xFF;
+    TB_ET = 1;
+    TB_TR = 1;
+    tbrunning = 1;
+}
+
+void tbisr(void) __interrupt(TIMEBASE_VECTOR)
+{
+    uint16_t reload = TB_RELOAD;
+
+#if TB_FRAC
+    _frac += TB_FRAC;
+    if (_frac >= 1000) {
+        _frac -= 1000;
+        reload--;                           // One count longer
+    }
+#endif
+#if TIMEBASE_TIMER == 2
+    // Not cleared by the hardware. The new reload value is used at the next overflow.
+    TF2 = 0;
+    RCAP2H = reload >> 8;
+    RCAP2L = reload & 0xFF;
+#else
+    _reload = reload + TB_STOPPED;
+    // The timer is stopped for 8 cycles, whatever the compiler made of the code above. ACC and PSW are
+    // saved here, as the C code may not use them.
+    __asm
+        push    acc
+        push    psw
+        clr     TB_ASM_TR                       // 1 cycle
+        mov     a, TB_ASM_TL                    // 1 cycle
+        add     a, __reload                     // 1 cycle
+        mov     TB_ASM_TL, a                    // 1 cycle
+        mov     a, TB_ASM_TH                    // 1 cycle
+        addc    a, (__reload + 1)               // 1 cycle
+        mov     TB_ASM_TH, a                    // 1 cycle
+        setb    TB_ASM_TR                       // 1 cycle
+        pop     psw
+        pop     acc
+    __endasm;
+#endif
+    _ms++;
+}
+
+uint16_t millis()
+{
+    uint16_t ms;
+
+    __critical {
+        ms = _ms;
+    }
+    return ms;
+}
+
+uint16_t micros()
+{
+    uint16_t ms;
+    uint16_t count;
+    unsigned char th;
+    __bit wrapped;
+
+    __critical {
+        ms = _ms;
+        wrapped = TB_TF;
+        do {
+            th = TB_TH;
+            count = ((uint16_t)th << 8) | TB_TL;
+        } while (th != TB_TH);
+        if (!wrapped && TB_TF) {
+            // Overflowed after the count was read: read it again.
+            wrapped = 1;
+            count = ((uint16_t)TB_TH << 8) | TB_TL;
+        }
+    }
+    // Cycles since the last tick: the count started at TB_RELOAD, or at 0 after an overflow the
+    // ISR has not handled yet (timers 0 and 1; timer 2 reloaded itself).
+    if (wrapped) {
+        ms++;
+#if TIMEBASE_TIMER != 2
+        count += TB_RELOAD;
+#endif
+    }
+    count -= TB_RELOAD;
+    // count < TB_CYCLES, so the product stays under 65536000
+    return ms * 1000 + (uint16_t)(((uint32_t)count * TB_US_SCALE) >> 16);
+}
+
+uint16_t tbdeadline(uint16_t ms)
+{
+    // One more, as the count may tick right after it is read.
+    return millis() + ms + 1;
+}
+
+uint8_t tbexpired(uint16_t deadline)
+{
+    return (int16_t)(millis() - deadline) >= 0;
+}
+
+#endif
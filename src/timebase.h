@@ -0,0 +1,64 @@
+/*
+    Hardware timebase: a timer interrupt counts milliseconds, so waits measured with it no longer
+    depend on the code generation nor on the time spent in other interrupts. Once tbinit() was
+    called, delay_ms() waits on millis() (while the interrupts are enabled), and millis() can be
+    passed to lcdinitstep() to run the LCD initialization as deadlines. It is built with the
+    config.h projects only.
+
+    Enable it in config.h:
+    #define TIMEBASE                // Use the timebase
+    #define TIMEBASE_TIMER 1        // Timer 0 or 1 (16 bit, reloaded by the ISR), or 2 (8052 only,
+                                    // 16 bit auto reload)
+    #define TIMEBASE_TIMER_DIV 12   // Oscillator periods per timer count: 12 on the standard core,
+                                    // and by default on the 1T derivatives. Also DELAY_TIMER_DIV.
+
+    tbinit() does not touch EA: enable the interrupts once it was called.
+
+    The interrupt service routine below must be visible in the file containing main(), which is
+    the case when that file includes delay.h.
+*/
+#include <stdint.h>
+#include "config.h"
+
+#ifndef TIMEBASE_TIMER_DIV
+#ifdef DELAY_TIMER_DIV
+#define TIMEBASE_TIMER_DIV      DELAY_TIMER_DIV
+#else
+#define TIMEBASE_TIMER_DIV      12
+#endif
+#endif
+
+#ifdef TIMEBASE
+
+#ifndef TIMEBASE_TIMER
+#define TIMEBASE_TIMER          1
+#endif
+
+#if TIMEBASE_TIMER == 2
+#define TIMEBASE_VECTOR         5   // TF2_VECTOR
+#elif TIMEBASE_TIMER == 1
+#define TIMEBASE_VECTOR         3   // TF1_VECTOR
+#else
+#define TIMEBASE_VECTOR         1   // TF0_VECTOR
+#endif
+
+#ifdef I2C_QUEUE
+#ifdef I2C_QUEUE_TIMER
+#define TIMEBASE_I2CQ_TIMER     I2C_QUEUE_TIMER
+#else
+#define TIMEBASE_I2CQ_TIMER     0
+#endif
+#if TIMEBASE_I2CQ_TIMER == TIMEBASE_TIMER
+#error "TIMEBASE_TIMER is already used by I2C_QUEUE."
+#endif
+#endif
+
+extern void tbinit();                       // Sets up the timer and enables its interrupt, not EA
+extern uint16_t millis();                   // Milliseconds since tbinit(), wraps around every 65.5 s
+extern uint16_t micros();                   // Microseconds, wraps around every 65.5 ms
+extern uint16_t tbdeadline(uint16_t ms);    // millis() value once at least 'ms' ms have elapsed
+extern uint8_t tbexpired(uint16_t deadline);// 1 once millis() reached the deadline (up to 32 s ahead)
+extern __bit tbrunning;                     // Set by tbinit()
+extern void tbisr(void) __interrupt(TIMEBASE_VECTOR);
+
+#endif